@@ -0,0 +1,227 @@
+#include "internal.h"
+#include "mappedfile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <random>
+
+namespace SF = Stockfish;
+
+// Book file layout, all integers little endian:
+//
+//   header  "FSBK", u16 version, u16 flags, u32 entry count, u64 key of the
+//           variant's start position, 48 bytes of variant name (NUL padded)
+//   entries u64 position key, u32 move, u32 weight; sorted by key and then
+//           by decreasing weight
+//
+// Keys and moves are those of this library's build, the start position key in
+// the header catches books built by an incompatible one.
+static char const _bookMagic[4]            = {'F', 'S', 'B', 'K'};
+static std::uint16_t const _bookVersion    = 1;
+static std::size_t const _bookNameSize     = 48;
+static std::size_t const _bookHeaderSize   = 4 + 2 + 2 + 4 + 8 + _bookNameSize;
+static std::size_t const _bookEntrySize    = 8 + 4 + 4;
+static std::uint16_t const _bookLargeBoard = 1;
+
+#ifdef LARGEBOARDS
+static std::uint16_t const _bookFlags = _bookLargeBoard;
+#else
+static std::uint16_t const _bookFlags = 0;
+#endif
+
+namespace {
+
+template <typename T>
+T readLE(char const *p) {
+    std::uint64_t value = 0;
+    for (std::size_t i = 0; i < sizeof(T); ++i)
+        value |= std::uint64_t(std::uint8_t(p[i])) << (8 * i);
+    return T(value);
+}
+
+template <typename T>
+void writeLE(std::ostream &out, T value) {
+    char bytes[sizeof(T)];
+    for (std::size_t i = 0; i < sizeof(T); ++i)
+        bytes[i] = char((std::uint64_t(value) >> (8 * i)) & 0xFF);
+    out.write(bytes, sizeof(T));
+}
+
+struct Book {
+    fairystockfish::MappedFile file;
+    std::size_t entries = 0;
+    // The definition of the variant the book was checked against, positions
+    // of another one (see loadVariantConfig()) don't use the book.
+    std::shared_ptr<SF::Variant const> variant;
+
+    char const *entry(std::size_t i) const {
+        return file.data() + _bookHeaderSize + i * _bookEntrySize;
+    }
+    std::uint64_t key(std::size_t i) const { return readLE<std::uint64_t>(entry(i)); }
+    std::uint32_t move(std::size_t i) const { return readLE<std::uint32_t>(entry(i) + 8); }
+    std::uint32_t weight(std::size_t i) const { return readLE<std::uint32_t>(entry(i) + 12); }
+
+    // The entries of a key, as a [first, last) range.
+    std::pair<std::size_t, std::size_t> find(std::uint64_t k) const {
+        std::size_t lo = 0, hi = entries;
+        while (lo < hi) {
+            std::size_t mid = lo + (hi - lo) / 2;
+            if (key(mid) < k) lo = mid + 1;
+            else hi = mid;
+        }
+        std::size_t last = lo;
+        while (last < entries && key(last) == k) ++last;
+        return {lo, last};
+    }
+};
+
+// Books are looked up without the engine lock, a lookup copies the pointer to
+// its book so that loadBook() can replace books meanwhile.
+std::mutex _booksMutex;
+std::map<std::string, std::shared_ptr<Book const>> _books;
+
+std::uint64_t startKey(std::string const &variantName) {
+    return fairystockfish::Position(variantName).key();
+}
+
+std::shared_ptr<Book const> bookFor(fairystockfish::Position const &position) {
+    auto const &variant = fairystockfish::internal::PositionAccess::variant(position);
+    std::lock_guard<std::mutex> guard(_booksMutex);
+    auto it = _books.find(position.variant);
+    return it == _books.end() || it->second->variant != variant ? nullptr : it->second;
+}
+
+}  // namespace
+
+void fairystockfish::Engine::loadBook(std::string variantName, std::string path) {
+    Position start(variantName);
+
+    auto book     = std::make_shared<Book>();
+    book->variant = internal::PositionAccess::variant(start);
+    book->file    = MappedFile(path);
+    if (!book->file.isOpen()) throw std::runtime_error("Cannot read book file '" + path + "'");
+
+    char const *header = book->file.data();
+    if (book->file.size() < _bookHeaderSize
+        || std::memcmp(header, _bookMagic, sizeof(_bookMagic)) != 0)
+        throw std::runtime_error("'" + path + "' is not a book file");
+    if (readLE<std::uint16_t>(header + 4) != _bookVersion)
+        throw std::runtime_error("Unsupported book file version in '" + path + "'");
+    if (readLE<std::uint16_t>(header + 6) != _bookFlags)
+        throw std::runtime_error("'" + path + "' was built for another board size");
+
+    book->entries = readLE<std::uint32_t>(header + 8);
+    if (book->file.size() != _bookHeaderSize + book->entries * _bookEntrySize)
+        throw std::runtime_error("Truncated book file '" + path + "'");
+
+    char const *name = header + 20;
+    std::string bookVariant(name, strnlen(name, _bookNameSize));
+    if (bookVariant != variantName)
+        throw std::runtime_error(
+            "'" + path + "' is a book for " + bookVariant + ", not " + variantName
+        );
+    if (readLE<std::uint64_t>(header + 12) != start.key())
+        throw std::runtime_error("'" + path + "' was built by an incompatible version");
+
+    std::lock_guard<std::mutex> guard(_booksMutex);
+    _books[variantName] = std::move(book);
+}
+
+std::vector<fairystockfish::BookMove> fairystockfish::Engine::bookMoves(Position const &position) {
+    auto book = bookFor(position);
+    if (!book) return {};
+
+    SF::Position const &pos = internal::PositionAccess::sf(position);
+    SF::MoveList<SF::LEGAL> legal(pos);
+
+    // Different positions can share a key, only legal moves are returned.
+    std::vector<BookMove> moves;
+    auto [first, last] = book->find(pos.key());
+    for (std::size_t i = first; i < last; ++i) {
+        SF::Move m = SF::Move(book->move(i));
+        if (legal.contains(m)) moves.push_back({SF::UCI::move(pos, m), book->weight(i)});
+    }
+    return moves;
+}
+
+std::string fairystockfish::Engine::bookMove(Position const &position) {
+    std::vector<BookMove> moves = bookMoves(position);
+
+    std::uint64_t total = 0;
+    for (auto const &m : moves) total += m.weight;
+    if (total == 0) return "";
+
+    thread_local std::mt19937_64 rng{std::random_device{}()};
+    std::uint64_t pick = std::uniform_int_distribution<std::uint64_t>(0, total - 1)(rng);
+    for (auto const &m : moves) {
+        if (pick < m.weight) return m.move;
+        pick -= m.weight;
+    }
+    return moves.back().move;
+}
+
+std::size_t fairystockfish::buildBook(
+    std::string variantName,
+    std::vector<std::vector<std::string>> const &games,
+    std::string path,
+    int maxPly,
+    std::uint32_t minWeight,
+    std::string startFen
+) {
+    internal::findVariant(variantName);
+    if (variantName.size() >= _bookNameSize)
+        throw std::runtime_error("buildBook: variant name too long: " + variantName);
+
+    Position const start
+        = startFen.empty() ? Position(variantName) : Position(variantName, startFen);
+
+    // (key, move) -> times played
+    std::map<std::pair<std::uint64_t, std::uint32_t>, std::uint64_t> counts;
+    for (auto const &game : games) {
+        Position pos = start;
+        for (std::size_t ply = 0; ply < game.size() && int(ply) < maxPly; ++ply) {
+            // Stop at the first move that isn't legal, the rest of the game is
+            // unreachable anyway.
+            std::string uciMove = game[ply];
+            SF::Move m = SF::UCI::to_move(internal::PositionAccess::sf(pos), uciMove);
+            if (m == SF::MOVE_NONE) break;
+            ++counts[{pos.key(), std::uint32_t(m)}];
+            pos = pos.makeMoves({game[ply]});
+        }
+    }
+
+    struct Entry {
+        std::uint64_t key;
+        std::uint32_t move;
+        std::uint32_t weight;
+    };
+    std::vector<Entry> entries;
+    for (auto const &[keyMove, count] : counts) {
+        if (count < std::max<std::uint32_t>(minWeight, 1)) continue;
+        std::uint32_t weight = std::uint32_t(std::min<std::uint64_t>(count, UINT32_MAX));
+        entries.push_back({keyMove.first, keyMove.second, weight});
+    }
+    std::sort(entries.begin(), entries.end(), [](Entry const &a, Entry const &b) {
+        return a.key != b.key ? a.key < b.key : a.weight > b.weight;
+    });
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) throw std::runtime_error("buildBook: cannot open '" + path + "'");
+    out.write(_bookMagic, sizeof(_bookMagic));
+    writeLE<std::uint16_t>(out, _bookVersion);
+    writeLE<std::uint16_t>(out, _bookFlags);
+    writeLE<std::uint32_t>(out, std::uint32_t(entries.size()));
+    writeLE<std::uint64_t>(out, startKey(variantName));
+    char name[_bookNameSize] = {};
+    std::memcpy(name, variantName.data(), variantName.size());
+    out.write(name, sizeof(name));
+    for (auto const &e : entries) {
+        writeLE<std::uint64_t>(out, e.key);
+        writeLE<std::uint32_t>(out, e.move);
+        writeLE<std::uint32_t>(out, e.weight);
+    }
+    if (!out.flush()) throw std::runtime_error("buildBook: cannot write '" + path + "'");
+    return entries.size();
+}
@@ -0,0 +1,217 @@
+#include "internal.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+
+namespace SF = Stockfish;
+
+// Latencies are kept for this many of the most recent jobs.
+static std::size_t const _latencyWindow = 10'000;
+
+namespace {
+
+struct Bot {
+    fairystockfish::BotConfig config;
+    // The definition of config.variant when the bot was created.
+    std::shared_ptr<SF::Variant const> variant;
+    // A value initialized table has no memory yet, the first job sizes it.
+    SF::TranspositionTable tt{};
+    bool sized = false;
+};
+
+struct Job {
+    std::shared_ptr<Bot> bot;
+    fairystockfish::Position position;
+    std::promise<fairystockfish::SearchResult> promise;
+    std::chrono::steady_clock::time_point submitted;
+};
+
+// Sets engine options for its lifetime.
+class ScopedOptions {
+  public:
+    ~ScopedOptions() {
+        for (auto it = _saved.rbegin(); it != _saved.rend(); ++it)
+            SF::Options[it->first] = it->second;
+    }
+
+    void set(std::string const &name, std::string const &value) {
+        std::string saved = SF::Options[name];
+        _saved.emplace_back(name, saved);
+        SF::Options[name] = value;
+    }
+
+  private:
+    std::vector<std::pair<std::string, std::string>> _saved;
+};
+
+double percentile(std::vector<double> values, double p) {
+    if (values.empty()) return 0;
+    auto nth = values.begin() + std::ptrdiff_t(p * double(values.size() - 1));
+    std::nth_element(values.begin(), nth, values.end());
+    return *nth;
+}
+
+}  // namespace
+
+struct fairystockfish::internal::BotPoolState {
+    std::size_t maxQueued;
+    mutable std::mutex mutex;
+    std::condition_variable wakeUp;
+    bool quit     = false;
+    int nextBotId = 1;
+    std::map<int, std::shared_ptr<Bot>> bots;
+    std::deque<Job> queue;
+
+    std::uint64_t completed = 0;
+    std::uint64_t rejected  = 0;
+    std::deque<double> latencies;
+
+    std::thread dispatcher;
+
+    void run();
+    SearchResult choose(Bot &bot, Position const &position);
+};
+
+fairystockfish::SearchResult
+fairystockfish::internal::BotPoolState::choose(Bot &bot, Position const &position) {
+    std::lock_guard<std::mutex> guard(engineMutex());
+    claimEngine();
+    ScopedTT scopedTT(bot.tt);
+    if (!bot.sized) {
+        SF::TT.resize(std::max<std::size_t>(bot.config.hashMB, 1));
+        bot.sized = true;
+    }
+
+    ScopedOptions options;
+    if (bot.config.elo > 0) {
+        options.set("UCI_LimitStrength", "true");
+        options.set("UCI_Elo", std::to_string(bot.config.elo));
+    } else {
+        options.set("UCI_LimitStrength", "false");
+        options.set("Skill Level", std::to_string(std::clamp(bot.config.skillLevel, 0, 20)));
+    }
+    options.set("MultiPV", "1");
+
+    SF::Search::LimitsType limits;
+    limits.nodes = std::int64_t(bot.config.nodes);
+    startSearch(position, limits);
+    return searchResult(waitForSearch(), position);
+}
+
+void fairystockfish::internal::BotPoolState::run() {
+    while (true) {
+        std::optional<Job> next;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeUp.wait(lock, [this] { return quit || !queue.empty(); });
+            if (quit) return;
+            next.emplace(std::move(queue.front()));
+            queue.pop_front();
+        }
+        Job &job = *next;
+
+        SearchResult result;
+        std::exception_ptr error;
+        try {
+            result = choose(*job.bot, job.position);
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        // Counted before the result is handed over, so that the stats include
+        // every job whose result the caller has seen.
+        std::chrono::duration<double, std::milli> latency
+            = std::chrono::steady_clock::now() - job.submitted;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++completed;
+            latencies.push_back(latency.count());
+            if (latencies.size() > _latencyWindow) latencies.pop_front();
+        }
+        if (error) job.promise.set_exception(error);
+        else job.promise.set_value(std::move(result));
+    }
+}
+
+fairystockfish::BotPool::BotPool(std::size_t maxQueued)
+    : _state{std::make_unique<internal::BotPoolState>()} {
+    _state->maxQueued  = std::max<std::size_t>(maxQueued, 1);
+    _state->dispatcher = std::thread([state = _state.get()] { state->run(); });
+}
+
+fairystockfish::BotPool::~BotPool() {
+    {
+        std::lock_guard<std::mutex> lock(_state->mutex);
+        _state->quit = true;
+    }
+    _state->wakeUp.notify_all();
+    _state->dispatcher.join();
+
+    for (auto &job : _state->queue)
+        job.promise.set_exception(
+            std::make_exception_ptr(std::runtime_error("BotPool: the pool was destroyed"))
+        );
+}
+
+int fairystockfish::BotPool::createBot(BotConfig const &config) {
+    // Without a node limit the bot's searches would never stop.
+    if (config.nodes == 0) throw std::invalid_argument("BotPool: nodes must be positive");
+    auto bot     = std::make_shared<Bot>();
+    bot->config  = config;
+    bot->variant = internal::findVariant(config.variant);
+
+    std::lock_guard<std::mutex> lock(_state->mutex);
+    int id = _state->nextBotId++;
+    _state->bots.emplace(id, std::move(bot));
+    return id;
+}
+
+void fairystockfish::BotPool::removeBot(int botId) {
+    std::lock_guard<std::mutex> lock(_state->mutex);
+    _state->bots.erase(botId);
+}
+
+std::future<fairystockfish::SearchResult>
+fairystockfish::BotPool::submit(int botId, Position const &position) {
+    Job job{nullptr, position, {}, std::chrono::steady_clock::now()};
+    auto result = job.promise.get_future();
+    {
+        std::lock_guard<std::mutex> lock(_state->mutex);
+        auto it = _state->bots.find(botId);
+        if (it == _state->bots.end())
+            throw std::runtime_error("BotPool: unknown bot " + std::to_string(botId));
+        if (it->second->variant != internal::PositionAccess::variant(position))
+            throw std::runtime_error(
+                "BotPool: the position isn't a " + it->second->config.variant
+                + " (of the definition the bot was created with)"
+            );
+        if (_state->queue.size() >= _state->maxQueued) {
+            ++_state->rejected;
+            throw std::runtime_error("BotPool: the queue is full");
+        }
+        job.bot = it->second;
+        _state->queue.push_back(std::move(job));
+    }
+    _state->wakeUp.notify_one();
+    return result;
+}
+
+fairystockfish::BotPoolStats fairystockfish::BotPool::stats() const {
+    std::vector<double> latencies;
+    BotPoolStats stats;
+    {
+        std::lock_guard<std::mutex> lock(_state->mutex);
+        stats.completed = _state->completed;
+        stats.rejected  = _state->rejected;
+        stats.queued    = _state->queue.size();
+        latencies.assign(_state->latencies.begin(), _state->latencies.end());
+    }
+    stats.p50Ms = percentile(latencies, 0.50);
+    stats.p99Ms = percentile(latencies, 0.99);
+    return stats;
+}
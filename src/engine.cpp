@@ -0,0 +1,540 @@
+#include "internal.h"
+#include "timeman.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+
+namespace SF = Stockfish;
+
+static fairystockfish::ClockStats _clockStats;
+
+// Size of the private transposition table of topMoves(), it's part of what
+// makes its results reproducible.
+static std::size_t const _topMovesHashMB    = 16;
+static std::size_t const _topMovesCacheSize = 4'096;
+
+// (variant, FEN, count, nodes) -> results. The key holds on to the variant, so
+// a redefinition can't reuse its address while it's cached.
+using TopMovesKey
+    = std::tuple<std::shared_ptr<SF::Variant const>, std::string, int, std::uint64_t>;
+static std::map<TopMovesKey, std::vector<fairystockfish::SearchResult>> _topMovesCache;
+
+// The root position of the current (or last) search. Threads::start_thinking
+// links the root state of every search thread to the StateInfo history of
+// this position, so it has to outlive the search.
+static std::unique_ptr<fairystockfish::Position> _searchRoot;
+
+// The clock of the side to move while a ponder search runs, see Engine::ponder.
+static std::unique_ptr<fairystockfish::Clock> _ponderClock;
+
+// Search statistics. The sampler thread reads the pool while a search runs,
+// it's always joined before the search is waited for or aborted. The engine
+// doesn't report finished iterations, so the depth timeline is only as fine
+// as the samples.
+static std::atomic<int> _samplingIntervalMs{0};
+static std::atomic<bool> _samplerStop{false};
+static std::thread _sampler;
+static std::chrono::steady_clock::time_point _searchStart;
+static std::mutex _statsMutex;  // Guards _liveStats and _lastStats
+static fairystockfish::SearchStats _liveStats;
+static fairystockfish::SearchStats _lastStats;
+static std::atomic<std::uint64_t> _totalSearches{0};
+static std::atomic<std::uint64_t> _totalNodes{0};
+static std::atomic<std::uint64_t> _totalTbHits{0};
+static std::atomic<std::uint64_t> _totalTimeMs{0};
+
+static int millisecondsSince(std::chrono::steady_clock::time_point start) {
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return int(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count());
+}
+
+// The search threads write these plain ints as they go, a relaxed atomic load
+// gives the sampler a clean read of them.
+static int relaxedLoad(int const &value) { return __atomic_load_n(&value, __ATOMIC_RELAXED); }
+
+// Fills in what can be read from the pool while the search runs.
+static void sampleSearch(fairystockfish::SearchStats &stats) {
+    SF::MainThread const *main = SF::Threads.main();
+    stats.nodes = stats.tbHits = stats.bestMoveChanges = 0;
+    stats.threadNodes.clear();
+    for (SF::Thread const *th : SF::Threads) {
+        stats.threadNodes.push_back(th->nodes.load(std::memory_order_relaxed));
+        stats.nodes += stats.threadNodes.back();
+        stats.tbHits += th->tbHits.load(std::memory_order_relaxed);
+        stats.bestMoveChanges += th->bestMoveChanges.load(std::memory_order_relaxed);
+    }
+    stats.depth    = relaxedLoad(main->completedDepth);
+    stats.selDepth = relaxedLoad(main->selDepth);
+    stats.timeMs   = millisecondsSince(_searchStart);
+    stats.nps      = stats.nodes * 1000 / std::uint64_t(std::max(stats.timeMs, 1));
+}
+
+static void sampleLoop(int intervalMs) {
+    fairystockfish::SearchStats stats;
+    stats.running = true;
+    while (!_samplerStop) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(intervalMs));
+        sampleSearch(stats);
+        if (stats.depth > (stats.iterations.empty() ? 0 : stats.iterations.back().depth))
+            stats.iterations.push_back({stats.depth, stats.timeMs, stats.nodes});
+
+        std::lock_guard<std::mutex> guard(_statsMutex);
+        _liveStats = stats;
+    }
+}
+
+static void stopSampler() {
+    if (!_sampler.joinable()) return;
+    _samplerStop = true;
+    _sampler.join();
+}
+
+// Called once the search is over, with the thread that holds its result.
+static void finishStats(SF::Thread const *best) {
+    fairystockfish::SearchStats stats;
+    {
+        std::lock_guard<std::mutex> guard(_statsMutex);
+        stats.iterations = std::move(_liveStats.iterations);
+        _liveStats       = fairystockfish::SearchStats{};
+    }
+    sampleSearch(stats);
+    stats.depth    = best->completedDepth;
+    stats.selDepth = best->rootMoves.empty() ? 0 : best->rootMoves[0].selDepth;
+    stats.hashfull = SF::TT.hashfull();
+    if (stats.depth > (stats.iterations.empty() ? 0 : stats.iterations.back().depth))
+        stats.iterations.push_back({stats.depth, stats.timeMs, stats.nodes});
+
+    ++_totalSearches;
+    _totalNodes += stats.nodes;
+    _totalTbHits += stats.tbHits;
+    _totalTimeMs += std::uint64_t(stats.timeMs);
+
+    std::lock_guard<std::mutex> guard(_statsMutex);
+    _lastStats = std::move(stats);
+}
+
+void fairystockfish::internal::startSearch(
+    Position const &position,
+    SF::Search::LimitsType limits,
+    bool ponderMode
+) {
+    claimEngine();
+    SF::Threads.main()->wait_for_search_finished();
+    _searchRoot = std::make_unique<Position>(position);
+    activateVariant(PositionAccess::sf(*_searchRoot).variant());
+
+    // start_thinking sets up the root of each thread from the FEN and then
+    // copies the last of these states, whose `previous` pointers lead back
+    // through the game history for repetition detection.
+    SF::StateListPtr states(new std::deque<SF::StateInfo>(1));
+    states->back() = PositionAccess::stateInfo(*_searchRoot);
+
+    limits.startTime = SF::now();
+    _searchStart     = std::chrono::steady_clock::now();
+    auto root        = PositionAccess::copy(*_searchRoot);
+    SF::Threads.start_thinking(*root, states, limits, ponderMode);
+
+    if (int interval = _samplingIntervalMs) {
+        _samplerStop = false;
+        _sampler     = std::thread(sampleLoop, interval);
+    }
+}
+
+SF::Thread *fairystockfish::internal::waitForSearch() {
+    SF::MainThread *main = SF::Threads.main();
+    main->wait_for_search_finished();
+    stopSampler();
+    SF::Thread *best = main;
+
+    // Mirrors MainThread::search(): the other threads only get a vote when
+    // neither MultiPV, a depth limit nor a skill level decide the move.
+    bool skill = int(SF::Options["Skill Level"]) < 20 || bool(SF::Options["UCI_LimitStrength"]);
+    if (int(SF::Options["MultiPV"]) == 1 && !SF::Search::Limits.depth && !skill
+        && !main->rootMoves.empty() && main->rootMoves[0].pv[0] != SF::MOVE_NONE)
+        best = SF::Threads.get_best_thread();
+    finishStats(best);
+    return best;
+}
+
+fairystockfish::SearchResult fairystockfish::internal::searchResult(
+    SF::Thread const *th,
+    Position const &position,
+    std::size_t index
+) {
+    SF::Position const &pos        = PositionAccess::sf(position);
+    SF::Search::RootMove const &rm = th->rootMoves[index];
+
+    SearchResult result;
+    if (rm.pv[0] != SF::MOVE_NONE) {
+        for (SF::Move m : rm.pv) result.pv.push_back(SF::UCI::move(pos, m));
+        result.bestMove = result.pv[0];
+        if (result.pv.size() > 1) result.ponderMove = result.pv[1];
+    }
+    // Same as UCI::pv(), a root move that wasn't searched at the last
+    // iteration reports its score from the previous one.
+    bool updated    = rm.score != -SF::VALUE_INFINITE;
+    result.score    = updated ? rm.score : rm.previousScore;
+    result.depth    = th->completedDepth;
+    result.selDepth = rm.selDepth;
+    result.nodes    = SF::Threads.nodes_searched();
+    return result;
+}
+
+static void swapTT(SF::TranspositionTable &a, SF::TranspositionTable &b) {
+    // The table is only a pointer, a size and a generation counter, which can
+    // be exchanged bytewise (just like Position::copyPosition copies positions).
+    alignas(SF::TranspositionTable) unsigned char tmp[sizeof(SF::TranspositionTable)];
+    std::memcpy(tmp, static_cast<void *>(&a), sizeof(tmp));
+    std::memcpy(static_cast<void *>(&a), static_cast<void *>(&b), sizeof(tmp));
+    std::memcpy(static_cast<void *>(&b), tmp, sizeof(tmp));
+}
+
+fairystockfish::internal::ScopedTT::ScopedTT(SF::TranspositionTable &tt)
+    : _tt{tt} {
+    swapTT(SF::TT, _tt);
+}
+
+fairystockfish::internal::ScopedTT::~ScopedTT() { swapTT(SF::TT, _tt); }
+
+fairystockfish::internal::FullStrength::FullStrength(int multiPV)
+    : _multiPV{option("MultiPV")}
+    , _skillLevel{option("Skill Level")}
+    , _limitStrength{option("UCI_LimitStrength")} {
+    SF::Options["MultiPV"]           = std::to_string(multiPV);
+    SF::Options["Skill Level"]       = std::string("20");
+    SF::Options["UCI_LimitStrength"] = std::string("false");
+}
+
+fairystockfish::internal::FullStrength::~FullStrength() {
+    SF::Options["MultiPV"]           = _multiPV;
+    SF::Options["Skill Level"]       = _skillLevel;
+    SF::Options["UCI_LimitStrength"] = _limitStrength;
+}
+
+std::string fairystockfish::internal::FullStrength::option(char const *name) {
+    return SF::Options[name];
+}
+
+static SF::Search::LimitsType clockLimits(fairystockfish::Clock const &clock) {
+    SF::Search::LimitsType limits;
+    limits.time[SF::WHITE] = clock.wtime;
+    limits.time[SF::BLACK] = clock.btime;
+    limits.inc[SF::WHITE]  = clock.winc;
+    limits.inc[SF::BLACK]  = clock.binc;
+    limits.movestogo       = clock.movestogo;
+    // The same as the USI "go byoyomi" command: the byo-yomi period is
+    // available on top of the main time, and is refilled on every move.
+    if (clock.byoyomi > 0) {
+        limits.inc[SF::WHITE] = limits.inc[SF::BLACK] = clock.byoyomi;
+        limits.time[SF::WHITE] += clock.byoyomi;
+        limits.time[SF::BLACK] += clock.byoyomi;
+    }
+    return limits;
+}
+
+// The time the side to move has left, throws if it has none at all.
+static int timeLeft(fairystockfish::Position const &position, fairystockfish::Clock const &clock) {
+    SF::Color us = fairystockfish::internal::PositionAccess::sf(position).side_to_move();
+    int time     = us == SF::WHITE ? clock.wtime : clock.btime;
+    if (time <= 0 && clock.byoyomi <= 0)
+        throw std::runtime_error("Engine: the side to move has no time left");
+    return time;
+}
+
+static void recordMove(fairystockfish::SearchResult const &result, int time, int byoyomi) {
+    ++_clockStats.moves;
+    _clockStats.totalTimeMs += result.timeMs;
+    if (result.timeMs > time + byoyomi) ++_clockStats.timeForfeits;
+}
+
+fairystockfish::SearchResult
+fairystockfish::Engine::play(Position const &position, Clock const &clock) {
+    int time = timeLeft(position, clock);
+
+    std::lock_guard<std::mutex> guard(internal::engineMutex());
+    auto start = std::chrono::steady_clock::now();
+    internal::startSearch(position, clockLimits(clock));
+    SearchResult result = internal::searchResult(internal::waitForSearch(), position);
+    result.timeMs       = millisecondsSince(start);
+    recordMove(result, time, clock.byoyomi);
+    return result;
+}
+
+void fairystockfish::Engine::ponder(Position const &expected, Clock const &clock) {
+    timeLeft(expected, clock);
+
+    std::lock_guard<std::mutex> guard(internal::engineMutex());
+    internal::startSearch(expected, clockLimits(clock), true);
+    _ponderClock = std::make_unique<Clock>(clock);
+}
+
+fairystockfish::SearchResult fairystockfish::Engine::ponderHit() {
+    std::lock_guard<std::mutex> guard(internal::engineMutex());
+    if (!_ponderClock) throw std::runtime_error("Engine::ponderHit: not pondering");
+    Clock clock = *_ponderClock;
+    _ponderClock.reset();
+
+    // Same as the UCI "ponderhit" command, the search goes on as a normal one
+    // and its time manager takes over.
+    auto start                 = std::chrono::steady_clock::now();
+    SF::Threads.main()->ponder = false;
+    SearchResult result        = internal::searchResult(internal::waitForSearch(), *_searchRoot);
+    result.timeMs              = millisecondsSince(start);
+    recordMove(result, timeLeft(*_searchRoot, clock), clock.byoyomi);
+    return result;
+}
+
+void fairystockfish::Engine::stopPondering() {
+    std::lock_guard<std::mutex> guard(internal::engineMutex());
+    internal::stopPondering();
+}
+
+bool fairystockfish::Engine::isPondering() {
+    std::lock_guard<std::mutex> guard(internal::engineMutex());
+    return _ponderClock != nullptr;
+}
+
+void fairystockfish::internal::stopPondering() {
+    if (!_ponderClock) return;
+    _ponderClock.reset();
+    // Like the UCI "stop" command, the result of the search is dropped.
+    SF::Threads.stop = true;
+    SF::Threads.main()->wait_for_search_finished();
+    stopSampler();
+    std::lock_guard<std::mutex> guard(_statsMutex);
+    _liveStats = SearchStats{};
+}
+
+void fairystockfish::internal::clearSearch() {
+    SF::Threads.main()->wait_for_search_finished();
+    SF::Time.availableNodes = 0;
+    SF::TT.clear();
+    SF::Threads.clear();
+}
+
+void fairystockfish::internal::clearSearchCaches() { _topMovesCache.clear(); }
+
+fairystockfish::ClockStats fairystockfish::Engine::clockStats() {
+    std::lock_guard<std::mutex> guard(internal::engineMutex());
+    return _clockStats;
+}
+
+void fairystockfish::Engine::resetClockStats() {
+    std::lock_guard<std::mutex> guard(internal::engineMutex());
+    _clockStats = ClockStats{};
+}
+
+namespace {
+
+// Gives the searches a single thread of their own, with clear histories, for
+// its lifetime. The pool's threads are set aside rather than destroyed, so
+// they keep their histories and the shared table isn't reallocated.
+//
+// Must be used with engineMutex() held and no search running.
+class ScopedSearchThread {
+  public:
+    ScopedSearchThread() : _thread(std::make_unique<SF::MainThread>(0)) {
+        _pool.swap(SF::Threads);
+        SF::Threads.push_back(_thread.get());
+        SF::Threads.clear();  // The histories of the new thread
+        SF::Search::init();  // The reductions depend on the number of threads
+    }
+
+    ~ScopedSearchThread() {
+        _pool.swap(SF::Threads);
+        SF::Search::init();
+    }
+
+    ScopedSearchThread(ScopedSearchThread const &)            = delete;
+    ScopedSearchThread &operator=(ScopedSearchThread const &) = delete;
+
+  private:
+    std::unique_ptr<SF::MainThread> _thread;
+    std::vector<SF::Thread *> _pool;
+};
+
+}  // namespace
+
+std::vector<fairystockfish::SearchResult>
+fairystockfish::Engine::topMoves(Position const &position, int count, std::uint64_t nodes) {
+    if (count <= 0 || nodes == 0) return {};
+    count = std::min(count, 500);  // The maximum of the MultiPV option
+
+    // Search from the FEN, so that the history leading to the position can't
+    // change the answer.
+    std::string fen = position.getFEN();
+    auto variant    = internal::PositionAccess::variant(position);
+    auto cacheKey   = std::make_tuple(variant, fen, count, nodes);
+
+    std::lock_guard<std::mutex> guard(internal::engineMutex());
+    auto cached = _topMovesCache.find(cacheKey);
+    if (cached != _topMovesCache.end()) return cached->second;
+
+    // The pool and the table are about to change under the search.
+    internal::claimEngine();
+
+    Position root = internal::PositionAccess::fromFEN(position, fen);
+
+    std::vector<SearchResult> results;
+    {
+        // A value initialized table has no memory yet, it's allocated (and
+        // cleared) by resize().
+        auto tt = std::make_unique<SF::TranspositionTable>();
+        internal::ScopedTT scopedTT(*tt);
+        SF::TT.resize(_topMovesHashMB);
+        ScopedSearchThread searchThread;
+        {
+            internal::FullStrength fullStrength(count);
+            SF::Search::LimitsType limits;
+            limits.nodes = std::int64_t(nodes);
+            internal::startSearch(root, limits);
+            SF::Thread *th = internal::waitForSearch();
+            for (std::size_t i = 0; i < std::min(std::size_t(count), th->rootMoves.size()); ++i) {
+                if (th->rootMoves[i].pv[0] == SF::MOVE_NONE) break;
+                results.push_back(internal::searchResult(th, root, i));
+            }
+        }
+    }
+
+    if (_topMovesCache.size() >= _topMovesCacheSize) _topMovesCache.clear();
+    _topMovesCache.emplace(cacheKey, results);
+    return results;
+}
+
+std::vector<fairystockfish::SearchResult> fairystockfish::Engine::rateMoves(
+    Position const &position,
+    std::vector<std::string> const &candidates,
+    std::uint64_t nodes
+) {
+    if (nodes == 0) throw std::invalid_argument("rateMoves: nodes must be positive");
+    std::vector<std::string> moves = candidates.empty() ? position.getLegalMoves() : candidates;
+    if (moves.empty()) return {};
+    if (moves.size() > 500) throw std::runtime_error("rateMoves: too many candidates");
+
+    SF::Search::LimitsType limits;
+    limits.nodes            = std::int64_t(nodes);
+    SF::Position const &pos = internal::PositionAccess::sf(position);
+    for (std::string move : moves) {
+        SF::Move m = SF::UCI::to_move(pos, move);
+        if (m == SF::MOVE_NONE) throw std::runtime_error("rateMoves: illegal move " + move);
+        limits.searchmoves.push_back(m);
+    }
+
+    std::lock_guard<std::mutex> guard(internal::engineMutex());
+    internal::claimEngine();
+    internal::FullStrength fullStrength(int(moves.size()));
+    internal::startSearch(position, limits);
+    SF::Thread *th = internal::waitForSearch();
+
+    // The root moves come sorted by score, put them back in candidate order.
+    std::vector<SearchResult> results(moves.size());
+    for (std::size_t i = 0; i < th->rootMoves.size(); ++i) {
+        for (std::size_t j = 0; j < moves.size(); ++j) {
+            if (limits.searchmoves[j] == th->rootMoves[i].pv[0])
+                results[j] = internal::searchResult(th, position, i);
+        }
+    }
+    return results;
+}
+
+static fairystockfish::MateResult
+searchMate(fairystockfish::Position const &position, int maxMovesToMate, std::uint64_t nodes) {
+    // The search stops by itself once it has proven a mate within limits.mate
+    // moves, the node limit bounds it when there is none.
+    SF::Search::LimitsType limits;
+    limits.mate  = maxMovesToMate;
+    limits.nodes = std::int64_t(nodes);
+    fairystockfish::internal::startSearch(position, limits);
+    auto search = fairystockfish::internal::searchResult(
+        fairystockfish::internal::waitForSearch(),
+        position
+    );
+
+    fairystockfish::MateResult result;
+    result.nodes = search.nodes;
+    int plies    = fairystockfish::VALUE_MATE - search.score;
+    if (!search.bestMove.empty() && plies <= 2 * maxMovesToMate) {
+        result.found       = true;
+        result.movesToMate = (plies + 1) / 2;
+        result.line        = search.pv;
+    }
+    return result;
+}
+
+fairystockfish::MateResult fairystockfish::Engine::findMate(
+    Position const &position,
+    int maxMovesToMate,
+    std::uint64_t nodes
+) {
+    if (maxMovesToMate <= 0 || nodes == 0)
+        throw std::runtime_error("findMate: maxMovesToMate and nodes must be positive");
+
+    std::lock_guard<std::mutex> guard(internal::engineMutex());
+    internal::claimEngine();
+    internal::FullStrength fullStrength;
+    return searchMate(position, maxMovesToMate, nodes);
+}
+
+fairystockfish::MateSearchStats fairystockfish::Engine::findMates(
+    std::vector<Position> const &positions,
+    int maxMovesToMate,
+    std::uint64_t nodes,
+    std::vector<MateResult> &results
+) {
+    if (maxMovesToMate <= 0 || nodes == 0)
+        throw std::runtime_error("findMates: maxMovesToMate and nodes must be positive");
+
+    std::lock_guard<std::mutex> guard(internal::engineMutex());
+    internal::claimEngine();
+    internal::FullStrength fullStrength;
+    results.clear();
+    results.reserve(positions.size());
+
+    MateSearchStats stats;
+    auto start = std::chrono::steady_clock::now();
+    for (auto const &position : positions) {
+        results.push_back(searchMate(position, maxMovesToMate, nodes));
+        if (results.back().found) ++stats.mates;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    stats.positions          = positions.size();
+    stats.seconds            = elapsed.count();
+    stats.positionsPerSecond = stats.seconds > 0 ? double(stats.positions) / stats.seconds : 0.0;
+    return stats;
+}
+
+fairystockfish::SearchStats fairystockfish::Engine::lastSearchStats() {
+    std::lock_guard<std::mutex> guard(_statsMutex);
+    return _lastStats;
+}
+
+void fairystockfish::Engine::setSearchSampling(int intervalMs) {
+    _samplingIntervalMs = std::max(intervalMs, 0);
+}
+
+fairystockfish::SearchStats fairystockfish::Engine::currentSearchStats() {
+    std::lock_guard<std::mutex> guard(_statsMutex);
+    return _liveStats;
+}
+
+fairystockfish::SearchTotals fairystockfish::Engine::searchTotals() {
+    SearchTotals totals;
+    totals.searches = _totalSearches;
+    totals.nodes    = _totalNodes;
+    totals.tbHits   = _totalTbHits;
+    totals.timeMs   = _totalTimeMs;
+    return totals;
+}
+
+void fairystockfish::Engine::resetSearchTotals() {
+    _totalSearches = _totalNodes = _totalTbHits = _totalTimeMs = 0;
+}
@@ -0,0 +1,153 @@
+#include "internal.h"
+#include "mappedfile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+namespace SF = Stockfish;
+
+// State file layout, in the host's byte order (the file is a raw dump, it's
+// only meant for the same build on the same kind of host):
+//
+//   header  "FSES", u32 version, u32 flags, u32 thread count,
+//           u64 hash size in MB, u64 hash table bytes, u64 history bytes per thread
+//   the hash table
+//   the history tables of each thread: main, capture, continuation, counter move
+//   and gate history
+static char const _stateMagic[4]         = {'F', 'S', 'E', 'S'};
+static std::uint32_t const _stateVersion = 2;
+
+#ifdef LARGEBOARDS
+static std::uint32_t const _stateFlags = 1;
+#else
+static std::uint32_t const _stateFlags = 0;
+#endif
+
+namespace {
+
+struct Header {
+    char magic[4];
+    std::uint32_t version;
+    std::uint32_t flags;
+    std::uint32_t threads;
+    std::uint64_t hashMB;
+    std::uint64_t tableBytes;
+    std::uint64_t historyBytes;
+};
+
+std::size_t const _historyBytes
+    = sizeof(SF::Thread::mainHistory) + sizeof(SF::Thread::captureHistory)
+    + sizeof(SF::Thread::continuationHistory) + sizeof(SF::Thread::counterMoves)
+    + sizeof(SF::Thread::gateHistory);
+
+// Calls f(table, bytes) for each history table of the thread, in file order.
+template<typename ThreadT, typename F>
+void forEachHistory(ThreadT *th, F &&f) {
+    f(&th->mainHistory, sizeof(th->mainHistory));
+    f(&th->captureHistory, sizeof(th->captureHistory));
+    f(&th->continuationHistory, sizeof(th->continuationHistory));
+    f(&th->counterMoves, sizeof(th->counterMoves));
+    f(&th->gateHistory, sizeof(th->gateHistory));
+}
+
+char *tableStart() { return reinterpret_cast<char *>(SF::TT.first_entry(0)); }
+
+char *clusterOf(SF::Key key) { return reinterpret_cast<char *>(SF::TT.first_entry(key)); }
+
+// Copies with all the cores, page faults on a fresh multi-GB table are what
+// takes the time.
+void parallelCopy(char *dst, char const *src, std::size_t size) {
+    std::size_t workers = std::max(1u, std::thread::hardware_concurrency());
+    std::size_t chunk   = (size + workers - 1) / workers;
+    std::vector<std::thread> threads;
+    for (std::size_t begin = 0; begin < size; begin += chunk) {
+        std::size_t n = std::min(chunk, size - begin);
+        threads.emplace_back([=] { std::memcpy(dst + begin, src + begin, n); });
+    }
+    for (auto &t : threads) t.join();
+}
+
+}  // namespace
+
+// The table is an array of clusters whose size is private to the engine.
+// first_entry() maps keys to clusters in order, so the smallest key past the
+// first cluster lands at the start of the second one, which gives the size of
+// a cluster, and the largest key lands in the last cluster.
+std::size_t fairystockfish::internal::hashTableBytes() {
+    char *start = tableStart();
+    SF::Key low = 0, high = ~SF::Key(0);
+    if (clusterOf(high) == start) throw std::runtime_error("Engine: unexpected hash table layout");
+    while (high - low > 1) {
+        SF::Key middle = low + (high - low) / 2;
+        if (clusterOf(middle) == start) low = middle;
+        else high = middle;
+    }
+    std::size_t clusterBytes = std::size_t(clusterOf(high) - start);
+    return std::size_t(clusterOf(~SF::Key(0)) - start) + clusterBytes;
+}
+
+void fairystockfish::Engine::saveState(std::string path) {
+    std::lock_guard<std::mutex> guard(internal::engineMutex());
+    internal::claimEngine();
+
+    Header header;
+    std::memcpy(header.magic, _stateMagic, sizeof(_stateMagic));
+    header.version      = _stateVersion;
+    header.flags        = _stateFlags;
+    header.threads      = std::uint32_t(SF::Threads.size());
+    header.hashMB       = std::uint64_t(std::size_t(SF::Options["Hash"]));
+    header.tableBytes   = internal::hashTableBytes();
+    header.historyBytes = _historyBytes;
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) throw std::runtime_error("Engine::saveState: cannot open '" + path + "'");
+    out.write(reinterpret_cast<char const *>(&header), sizeof(header));
+    out.write(tableStart(), std::streamsize(header.tableBytes));
+    for (SF::Thread const *th : SF::Threads) {
+        forEachHistory(th, [&](void const *table, std::size_t bytes) {
+            out.write(static_cast<char const *>(table), std::streamsize(bytes));
+        });
+    }
+    if (!out.flush()) throw std::runtime_error("Engine::saveState: cannot write '" + path + "'");
+}
+
+void fairystockfish::Engine::loadState(std::string path) {
+    MappedFile file(path);
+    if (!file.isOpen()) throw std::runtime_error("Cannot read engine state '" + path + "'");
+    file.willNeed();
+
+    Header header;
+    if (file.size() >= sizeof(header)) std::memcpy(&header, file.data(), sizeof(header));
+    if (file.size() < sizeof(header)
+        || std::memcmp(header.magic, _stateMagic, sizeof(_stateMagic)) != 0)
+        throw std::runtime_error("'" + path + "' is not an engine state");
+    if (header.version != _stateVersion || header.flags != _stateFlags
+        || header.historyBytes != _historyBytes)
+        throw std::runtime_error("'" + path + "' was saved by an incompatible build");
+    if (file.size() != sizeof(header) + header.tableBytes + header.threads * header.historyBytes)
+        throw std::runtime_error("Truncated engine state '" + path + "'");
+
+    std::lock_guard<std::mutex> guard(internal::engineMutex());
+    internal::claimEngine();
+    internal::clearSearchCaches();
+    // Resizes (and clears) the table.
+    SF::Options["Hash"] = std::to_string(header.hashMB);
+    if (internal::hashTableBytes() != header.tableBytes)
+        throw std::runtime_error("'" + path + "' was saved by an incompatible build");
+
+    char const *data = file.data() + sizeof(header);
+    parallelCopy(tableStart(), data, header.tableBytes);
+    data += header.tableBytes;
+
+    // With a different number of threads, the first ones get their tables back.
+    std::size_t threads = std::min<std::size_t>(header.threads, SF::Threads.size());
+    for (std::size_t i = 0; i < threads; ++i, data += header.historyBytes) {
+        char const *p = data;
+        forEachHistory(SF::Threads[i], [&](void *table, std::size_t bytes) {
+            std::memcpy(table, p, bytes);
+            p += bytes;
+        });
+    }
+}
@@ -1,21 +1,229 @@
 #include "fairystockfish.h"
 
+#include "internal.h"
+#include "mappedfile.h"
 #include "tabulate.hpp"
 #include "types.h"
 
+#include <atomic>
+#include <chrono>
 #include <climits>
+#include <cstring>
 #include <iostream>
+#include <map>
+#include <memory>
 #include <mutex>
 #include <set>
 #include <sstream>
+#include <thread>
 
 namespace SF = Stockfish;
 
+#ifndef FAIRYSTOCKFISH_ARCH
+#    define FAIRYSTOCKFISH_ARCH "generic"
+#endif
+
 static bool _fairystockfish_is_initialized = false;
 static std::mutex _canInitialize;
+static fairystockfish::InitReport _initReport;
 int const fairystockfish::VALUE_ZERO = 0;
 int const fairystockfish::VALUE_DRAW = 0;
 int const fairystockfish::VALUE_MATE = 32'000;
+int const fairystockfish::VALUE_NONE = 32'002;
+static SF::Variant const *_activeVariant = nullptr;
+
+// What PSQT::init computes for a variant. It only depends on the variant, so
+// it's computed once per variant and copied back in when switching to it.
+struct VariantTables {
+    SF::Score psq[SF::PIECE_NB][SF::SQUARE_NB + 1];
+    SF::Value pieceValue[SF::PHASE_NB][SF::PIECE_NB];
+    SF::Value evalPieceValue[SF::PHASE_NB][SF::PIECE_NB];
+    SF::Value capturePieceValue[SF::PHASE_NB][SF::PIECE_NB];
+};
+static std::map<SF::Variant const *, std::unique_ptr<VariantTables>> _variantTables;
+
+std::mutex &fairystockfish::internal::engineMutex() {
+    static std::mutex engineMutex;
+    return engineMutex;
+}
+
+// Published with std::atomic_store, read with std::atomic_load.
+static std::shared_ptr<fairystockfish::internal::VariantRegistry const> _variantRegistry;
+
+// The variants the engine defines, set once by init(). They are never freed.
+static std::map<std::string, SF::Variant const *, std::less<>> _builtinVariants;
+
+// Variants whose last reference is gone, waiting for collectRetiredVariants().
+// Deliberately leaked: references can be dropped during static destruction.
+static std::mutex &retiredMutex() {
+    static std::mutex *mutex = new std::mutex;
+    return *mutex;
+}
+static std::vector<SF::Variant const *> &retiredVariants() {
+    static auto *retired = new std::vector<SF::Variant const *>;
+    return *retired;
+}
+
+// Takes ownership of a variant made by the variant parser. The engine's
+// tables may still know its address, so it's only handed over for deletion.
+static std::shared_ptr<SF::Variant const> adoptVariant(SF::Variant const *v) {
+    return std::shared_ptr<SF::Variant const>(v, [](SF::Variant const *retired) {
+        std::lock_guard<std::mutex> guard(retiredMutex());
+        retiredVariants().push_back(retired);
+    });
+}
+
+template <typename PieceTypes>
+static void
+addPieceChars(std::set<char> &chars, SF::Variant const *variant, PieceTypes const &pieceTypes) {
+    auto addPiece = [&](char p) {
+        if (p != ' ') chars.insert(p);
+    };
+    for (SF::PieceType pt = SF::NO_PIECE_TYPE; pt < SF::PIECE_TYPE_NB; ++pt) {
+        if (!(SF::piece_set(pt) & pieceTypes)) continue;
+        auto whitePiece = make_piece(SF::WHITE, pt);
+        auto blackPiece = make_piece(SF::BLACK, pt);
+
+        addPiece(variant->pieceToChar[whitePiece]);
+        addPiece(variant->pieceToChar[blackPiece]);
+        addPiece(variant->pieceToCharSynonyms[whitePiece]);
+        addPiece(variant->pieceToCharSynonyms[blackPiece]);
+    }
+}
+
+// There are only a handful of distinct piece char sets, they're kept (and
+// shared between registries) for the life of the process.
+static std::string_view internChars(std::set<char> const &chars) {
+    static auto *mutex    = new std::mutex;
+    static auto *interned = new std::set<std::string>;
+    std::lock_guard<std::mutex> guard(*mutex);
+    return *interned->emplace(chars.begin(), chars.end()).first;
+}
+
+static fairystockfish::VariantInfo describeVariant(
+    std::string const &name,
+    SF::Variant const *variant,
+    fairystockfish::internal::VariantRegistry::PieceChars const &chars
+) {
+    fairystockfish::VariantInfo info;
+    info.name     = name;
+    info.startFen = variant->startFen;
+    info.files    = int(variant->maxFile) + 1;
+    info.ranks    = int(variant->maxRank) + 1;
+    for (SF::PieceType pt = SF::NO_PIECE_TYPE; pt < SF::PIECE_TYPE_NB; ++pt) {
+        if (!(SF::piece_set(pt) & variant->pieceTypes)) continue;
+        info.pieces.push_back(
+            {fairystockfish::PieceInfo(pt),
+             variant->pieceToChar[make_piece(SF::WHITE, pt)],
+             variant->pieceToChar[make_piece(SF::BLACK, pt)]}
+        );
+    }
+    info.pieceChars           = std::string(chars.all);
+    info.promotablePieceChars = std::string(chars.promotable);
+    info.drops                = variant->pieceDrops;
+    info.gating               = variant->gating;
+    info.walls                = variant->wallingRule != SF::NO_WALLING;
+    info.castling             = variant->castling;
+    info.counting             = variant->countingRule != SF::NO_COUNTING;
+    return info;
+}
+
+// Computes the piece chars and descriptions of a registry that's about to be
+// published.
+static void indexVariants(fairystockfish::internal::VariantRegistry &registry) {
+    std::set<char> all, promotable;
+    registry.pieceChars.clear();
+    registry.info.clear();
+    for (auto const &[name, variant] : registry.variants) {
+        std::set<char> variantAll, variantPromotable;
+        addPieceChars(variantAll, variant.get(), variant->pieceTypes);
+        addPieceChars(variantPromotable, variant.get(), variant->promotionPieceTypes[0]);
+        addPieceChars(variantPromotable, variant.get(), variant->promotionPieceTypes[1]);
+        auto &chars = registry.pieceChars[name];
+        chars       = {internChars(variantAll), internChars(variantPromotable)};
+        registry.info.emplace(name, describeVariant(name, variant.get(), chars));
+        all.insert(variantAll.begin(), variantAll.end());
+        promotable.insert(variantPromotable.begin(), variantPromotable.end());
+    }
+    registry.allPieceChars = {internChars(all), internChars(promotable)};
+}
+
+// Publishes a registry to the wrapper, and to the engine's own variant map
+// (which its option handlers look variants up in). Must be called with
+// engineMutex() held.
+static void publishVariants(std::shared_ptr<fairystockfish::internal::VariantRegistry> r) {
+    indexVariants(*r);
+    SF::variants.clear();
+    for (auto const &[name, v] : r->variants) SF::variants.emplace(name, v.get());
+    SF::Options["UCI_Variant"].set_combo(SF::variants.get_keys());
+    std::shared_ptr<fairystockfish::internal::VariantRegistry const> published = std::move(r);
+    std::atomic_store(&_variantRegistry, std::move(published));
+}
+
+std::shared_ptr<fairystockfish::internal::VariantRegistry const>
+fairystockfish::internal::variantRegistry() {
+    return std::atomic_load(&_variantRegistry);
+}
+
+std::shared_ptr<SF::Variant const> fairystockfish::internal::findVariant(std::string const &name) {
+    auto registry = variantRegistry();
+    auto it       = registry->variants.find(name);
+    if (it == registry->variants.end()) throw std::runtime_error("Unknown variant: '" + name + "'");
+    return it->second;
+}
+
+SF::Variant const *fairystockfish::internal::builtinVariant(std::string_view name) {
+    auto it = _builtinVariants.find(name);
+    return it == _builtinVariants.end() ? nullptr : it->second;
+}
+
+void fairystockfish::internal::collectRetiredVariants() {
+    std::vector<SF::Variant const *> retired;
+    {
+        std::lock_guard<std::mutex> guard(retiredMutex());
+        retired.swap(retiredVariants());
+    }
+    for (SF::Variant const *v : retired) {
+        // A later variant can get the same address.
+        _variantTables.erase(v);
+        if (_activeVariant == v) _activeVariant = nullptr;
+        delete v;
+    }
+}
+
+SF::Thread *fairystockfish::internal::positionThread() {
+    // Deliberately leaked: it must outlive every Position, including static ones.
+    static SF::Thread *th = new SF::Thread(0);
+    return th;
+}
+
+void fairystockfish::internal::activateVariant(SF::Variant const *v) {
+    if (v == _activeVariant) return;
+
+    auto &tables = _variantTables[v];
+    if (!tables) {
+        SF::PSQT::init(v);
+        tables = std::make_unique<VariantTables>();
+        std::memcpy(tables->psq, SF::PSQT::psq, sizeof(tables->psq));
+        std::memcpy(tables->pieceValue, SF::PieceValue, sizeof(tables->pieceValue));
+        std::memcpy(tables->evalPieceValue, SF::EvalPieceValue, sizeof(tables->evalPieceValue));
+        std::memcpy(
+            tables->capturePieceValue,
+            SF::CapturePieceValue,
+            sizeof(tables->capturePieceValue)
+        );
+    } else {
+        std::memcpy(SF::PSQT::psq, tables->psq, sizeof(tables->psq));
+        std::memcpy(SF::PieceValue, tables->pieceValue, sizeof(tables->pieceValue));
+        std::memcpy(SF::EvalPieceValue, tables->evalPieceValue, sizeof(tables->evalPieceValue));
+        std::memcpy(
+            SF::CapturePieceValue,
+            tables->capturePieceValue,
+            sizeof(tables->capturePieceValue)
+        );
+    }
+    _activeVariant = v;
+}
 
 //------------------------------------------------------------------------------
 // This struct is an internal API intended to build a position from variant,
@@ -45,29 +253,203 @@ int fairystockfish::Piece::color() const { return static_cast<int>(_color); }
 
 bool fairystockfish::Piece::promoted() const { return _promoted; }
 
-void fairystockfish::init() {
+// ISA levels from lowest to highest, each one implies the previous ones.
+static std::vector<std::string> const _archLevels = {
+    "generic",
+    "x86-64",
+    "x86-64-sse41-popcnt",
+    "x86-64-avx2",
+    "x86-64-bmi2",
+    "x86-64-avx512",
+    "x86-64-vnni512",
+};
+
+static bool hostSupportsArch(std::string const &arch) {
+    if (arch == "generic") return true;
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    bool supported = __builtin_cpu_supports("sse2");
+    if (arch == "x86-64") return supported;
+    supported = supported && __builtin_cpu_supports("ssse3") && __builtin_cpu_supports("sse4.1")
+             && __builtin_cpu_supports("popcnt");
+    if (arch == "x86-64-sse41-popcnt") return supported;
+    supported = supported && __builtin_cpu_supports("avx2");
+    if (arch == "x86-64-avx2") return supported;
+    supported = supported && __builtin_cpu_supports("bmi2");
+    if (arch == "x86-64-bmi2") return supported;
+    supported = supported && __builtin_cpu_supports("avx512f")
+             && __builtin_cpu_supports("avx512bw");
+    if (arch == "x86-64-avx512") return supported;
+    supported = supported && __builtin_cpu_supports("avx512vnni")
+             && __builtin_cpu_supports("avx512dq") && __builtin_cpu_supports("avx512vl");
+    if (arch == "x86-64-vnni512") return supported;
+#endif
+    return false;
+}
+
+std::string fairystockfish::compiledArch() { return FAIRYSTOCKFISH_ARCH; }
+
+bool fairystockfish::largeBoards() {
+#ifdef LARGEBOARDS
+    return true;
+#else
+    return false;
+#endif
+}
+
+std::string fairystockfish::bestSupportedArch() {
+    for (auto it = _archLevels.rbegin(); it != _archLevels.rend(); ++it) {
+        if (hostSupportsArch(*it)) return *it;
+    }
+    return "generic";
+}
+
+// Drops the variants that the library wasn't configured with (see
+// FAIRYSTOCKFISH_VARIANTS in CMakeLists.txt). chess always stays, the engine's
+// option defaults refer to it.
+static void keepConfiguredVariants() {
+#ifdef FAIRYSTOCKFISH_VARIANTS
+    std::set<std::string> keep{"chess"};
+    std::stringstream names(FAIRYSTOCKFISH_VARIANTS);
+    for (std::string name; std::getline(names, name, ',');) {
+        if (!SF::variants.count(name))
+            throw std::runtime_error(
+                "FAIRYSTOCKFISH_VARIANTS: '" + name + "' isn't a variant of this build"
+            );
+        keep.insert(name);
+    }
+    for (auto it = SF::variants.begin(); it != SF::variants.end();)
+        it = keep.count(it->first) ? std::next(it) : SF::variants.erase(it);
+#endif
+}
+
+template <typename F>
+static void timedPhase(char const *name, F &&phase) {
+    auto start = std::chrono::steady_clock::now();
+    phase();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    _initReport.phases.push_back({name, elapsed.count()});
+    _initReport.totalMs += elapsed.count();
+}
+
+// "Threads" and "Hash" set while there is no thread pool (before a lazy init()
+// creates it, or after prepareFork() stops it), see deferOption(). Guarded by
+// _canInitialize.
+static std::map<std::string, std::string> _deferredOptions;
+
+// Options that act on the thread pool or the hash table are kept for
+// startThreads() while there is no pool, instead of forcing a lazy init() to
+// finish. Returns whether the option was deferred.
+static bool deferOption(std::string const &name, std::string const &value) {
+    std::lock_guard<std::mutex> guard(_canInitialize);
+    if (_initReport.searchReady && !SF::Threads.empty()) return false;
+    SF::UCI::Option const *option = &SF::Options[name];
+    // startThreads() clears the table and the histories, nothing to keep.
+    if (option == &SF::Options["Clear Hash"]) return true;
+    for (char const *deferred : {"Threads", "Hash"}) {
+        if (option == &SF::Options[deferred]) {
+            _deferredOptions[deferred] = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Creates the thread pool, with the options deferred while there was none.
+// Must be called with _canInitialize held.
+static void startThreads() {
+    // Setting "Threads" creates the pool (and sizes the table).
+    if (auto threads = _deferredOptions.find("Threads"); threads != _deferredOptions.end())
+        SF::Options["Threads"] = threads->second;
+    if (SF::Threads.empty()) SF::Threads.set(SF::Options["Threads"]);
+    if (auto hash = _deferredOptions.find("Hash"); hash != _deferredOptions.end())
+        SF::Options["Hash"] = hash->second;
+    _deferredOptions.clear();
+    fairystockfish::internal::clearSearch();
+}
+
+// The phases only searches and evaluations need. Must be called with
+// _canInitialize held.
+static void initSearch() {
+    if (_initReport.searchReady) return;
+    timedPhase("bitbases", [] { SF::Bitbases::init(); });
+    timedPhase("search", [] { SF::Search::init(); });
+    timedPhase("endgames", [] { SF::Endgames::init(); });
+    timedPhase("threads", startThreads);
+    _initReport.searchReady = true;
+}
+
+fairystockfish::InitReport fairystockfish::init(bool lazy) {
     std::lock_guard<std::mutex> guard(_canInitialize);
     if (_fairystockfish_is_initialized) {
-        return;
+        return _initReport;
     }
+    // Fail loudly instead of dying with SIGILL inside the first search.
+    if (!hostSupportsArch(compiledArch()))
+        throw std::runtime_error(
+            "fairystockfish was compiled for " + compiledArch() + " but this CPU only supports "
+            + bestSupportedArch()
+        );
     _fairystockfish_is_initialized = true;
 
     // initialize stockfish
-    SF::pieceMap.init();
-    SF::variants.init();
-    SF::UCI::init(SF::Options);
-    SF::Tune::init();
-    SF::PSQT::init(SF::variants.find(SF::Options["UCI_Variant"])->second);
-    SF::Bitboards::init();
-    SF::Position::init();
-    SF::Bitbases::init();
-    SF::Search::init();
-    SF::Endgames::init();
-    SF::Threads.set(SF::Options["Threads"]);
-    SF::Search::clear();  // After threads are up
+    timedPhase("pieces", [] { SF::pieceMap.init(); });
+    timedPhase("variants", [] {
+        SF::variants.init();
+        keepConfiguredVariants();
+        // The built-in variants belong to the engine.
+        auto registry = std::make_shared<internal::VariantRegistry>();
+        for (auto const &[name, v] : SF::variants) {
+            registry->variants.emplace(name, std::shared_ptr<SF::Variant const>(v, [](auto) {}));
+            _builtinVariants.emplace(name, v);
+        }
+        indexVariants(*registry);
+        _variantRegistry = std::move(registry);
+    });
+    timedPhase("options", [] {
+        SF::UCI::init(SF::Options);
+        SF::Tune::init();
+    });
+    timedPhase("psqt", [] {
+        internal::activateVariant(SF::variants.find(SF::Options["UCI_Variant"])->second);
+    });
+    timedPhase("bitboards", [] { SF::Bitboards::init(); });
+    timedPhase("zobrist", [] { SF::Position::init(); });
+    if (!lazy) initSearch();
 
     // Initialize only amazons. Initializing the rest is pointless.
-    SF::UCI::init_variant(SF::variants.find("amazons")->second);
+    if (auto amazons = SF::variants.find("amazons"); amazons != SF::variants.end())
+        timedPhase("amazons", [&] { SF::UCI::init_variant(amazons->second); });
+    return _initReport;
+}
+
+fairystockfish::InitReport fairystockfish::initReport() {
+    std::lock_guard<std::mutex> guard(_canInitialize);
+    return _initReport;
+}
+
+void fairystockfish::prepareFork() {
+    init(true);
+    std::lock_guard<std::mutex> guard(internal::engineMutex());
+    // Threads don't survive a fork(). The next search starts the pool again,
+    // in this process and in each child.
+    internal::stopPondering();
+    SF::Threads.set(0);
+
+    SF::Variant const *active = _activeVariant;
+    for (auto const &[name, v] : SF::variants) internal::activateVariant(v);
+    if (active) internal::activateVariant(active);
+}
+
+void fairystockfish::internal::claimEngine() {
+    {
+        std::lock_guard<std::mutex> guard(_canInitialize);
+        initSearch();
+        // Stopped by prepareFork().
+        if (SF::Threads.empty()) startThreads();
+    }
+    stopPondering();
+    collectRetiredVariants();
 }
 
 // TODO: make it so that the version number comes from compile time settings.
@@ -76,6 +458,9 @@ std::string fairystockfish::version() { return "v0.0.20"; }
 void fairystockfish::info() {
     // Now print out some information
     using namespace tabulate;
+    std::cout << "[Fairy-Stockfish-Lib] Compiled for " << compiledArch()
+              << ", best supported by this CPU: " << bestSupportedArch() << std::endl;
+
     Table variantTable;
     std::cout << "[Fairy-Stockfish-Lib] Available Variants" << std::endl;
     variantTable.add_row({"Variant Name", "Initial FEN"});
@@ -92,20 +477,100 @@ void fairystockfish::info() {
 }
 
 void fairystockfish::setUCIOption(std::string name, std::string value) {
-    if (SF::Options.count(name)) SF::Options[name] = value;
-    else throw std::runtime_error("Unrecognized option");
+    if (!SF::Options.count(name)) throw std::runtime_error("Unrecognized option");
+    std::lock_guard<std::mutex> guard(internal::engineMutex());
+    // "SyzygyPath" and "Clear Hash" reinitialize the tablebases.
+    std::unique_lock<std::shared_mutex> tablebases(internal::tablebasesMutex());
+    // Only the options that act on the pool or the table need the search
+    // initialized, and those wait for it rather than forcing it.
+    internal::stopPondering();
+    if (!deferOption(name, value)) SF::Options[name] = value;
+    internal::clearSearchCaches();
+    // Setting UCI_Variant reinitializes the tables behind activateVariant's back.
+    _activeVariant = nullptr;
 }
 
 void fairystockfish::loadVariantConfig(std::string config) {
     std::stringstream ss(config);
-    SF::variants.parse_istream<false>(ss);
-    SF::Options["UCI_Variant"].set_combo(SF::variants.get_keys());
+    internal::loadVariants(ss);
+}
+
+// Splits an ini style variant configuration into (name, text) sections.
+static std::vector<std::pair<std::string, std::string>> variantSections(std::istream &config) {
+    std::vector<std::pair<std::string, std::string>> sections;
+    std::string line;
+    while (std::getline(config, line)) {
+        auto first = line.find_first_not_of(" \t\r");
+        if (first != std::string::npos && line[first] == '[') {
+            auto end = line.find_first_of(":]", first);
+            sections.emplace_back(line.substr(first + 1, end - first - 1), "");
+        }
+        // The parser skips everything before the first section.
+        if (sections.empty()) continue;
+        sections.back().second += line;
+        sections.back().second += '\n';
+    }
+    return sections;
+}
+
+void fairystockfish::internal::loadVariants(std::istream &config) {
+    std::lock_guard<std::mutex> guard(engineMutex());
+    stopPondering();
+    clearSearchCaches();
+    collectRetiredVariants();
+
+    auto registry = std::make_shared<VariantRegistry>(*variantRegistry());
+    ++registry->generation;
+
+    // Sections are parsed one at a time into a map of their own, without the
+    // variant they redefine, so that the parser makes a new variant instead of
+    // replacing the published one, which positions may still use.
+    SF::VariantMap parsed;
+    for (auto const &[name, v] : registry->variants) parsed.emplace(name, v.get());
+    for (auto const &[name, text] : variantSections(config)) {
+        auto old = parsed.find(name);
+        SF::Variant const *previous = old == parsed.end() ? nullptr : old->second;
+        if (previous) parsed.erase(old);
+
+        std::istringstream section(text);
+        parsed.parse_istream<false>(section);
+        auto it = parsed.find(name);
+        if (it != parsed.end()) registry->variants[name] = adoptVariant(it->second);
+        // A section that doesn't parse leaves the variant as it was.
+        else if (previous) parsed.emplace(name, previous);
+    }
+    publishVariants(registry);
 }
 
-std::vector<std::string> fairystockfish::availableVariants() { return SF::variants.get_keys(); }
+bool fairystockfish::loadEvalFile(std::string path) {
+    std::lock_guard<std::mutex> guard(internal::engineMutex());
+    internal::stopPondering();
+    internal::clearSearchCaches();
+
+    MappedFile file(path);
+    if (!file.isOpen()) return false;
+
+    file.willNeed();
+    MemoryStreamBuf buffer(file.data(), file.size());
+    std::istream stream(&buffer);
+    if (!SF::Eval::NNUE::load_eval(path, stream)) return false;
+
+    // Mark the network as loaded before pointing the options at it, so the
+    // option change handlers don't read the file a second time.
+    SF::Eval::currentEvalFileName = path;
+    SF::Options["EvalFile"]       = path;
+    SF::Options["Use NNUE"]       = std::string("true");
+    return true;
+}
+
+std::vector<std::string> fairystockfish::availableVariants() {
+    std::vector<std::string> names;
+    for (auto const &[name, v] : internal::variantRegistry()->variants) names.push_back(name);
+    return names;
+}
 
 std::string fairystockfish::initialFen(std::string variantName) {
-    return SF::variants[variantName]->startFen;
+    return internal::findVariant(variantName)->startFen;
 }
 
 std::map<std::string, fairystockfish::PieceInfo> fairystockfish::availablePieces() {
@@ -116,55 +581,50 @@ std::map<std::string, fairystockfish::PieceInfo> fairystockfish::availablePieces
     return retVal;
 }
 
-enum class IsPromotable { PROMOTABLE, ALL };
+std::string fairystockfish::availablePieceChars() {
+    return std::string(internal::variantRegistry()->allPieceChars.all);
+}
 
-static std::string availablePieceChars__impl(IsPromotable t) {
-    std::set<char> pieces;
-    auto addPiece = [&](char p) {
-        if (p != ' ') pieces.insert(p);
-    };
+std::string fairystockfish::availablePromotablePieceChars() {
+    return std::string(internal::variantRegistry()->allPieceChars.promotable);
+}
 
-    auto copy = [&](auto const &pieceTypes, SF::Variant const *variant) {
-        for (Stockfish::PieceType pt = Stockfish::NO_PIECE_TYPE; pt < Stockfish::PIECE_TYPE_NB;
-             ++pt)
-        {
-            if (!(Stockfish::piece_set(pt) & pieceTypes)) {
-                continue;
-            }
-            auto whitePiece = make_piece(SF::WHITE, pt);
-            auto blackPiece = make_piece(SF::BLACK, pt);
+static fairystockfish::internal::VariantRegistry::PieceChars
+variantPieceChars(std::string_view variantName) {
+    auto registry = fairystockfish::internal::variantRegistry();
+    auto it       = registry->pieceChars.find(variantName);
+    if (it == registry->pieceChars.end())
+        throw std::runtime_error("Unknown variant: '" + std::string(variantName) + "'");
+    return it->second;
+}
 
-            addPiece(variant->pieceToChar[whitePiece]);
-            addPiece(variant->pieceToChar[blackPiece]);
-            addPiece(variant->pieceToCharSynonyms[whitePiece]);
-            addPiece(variant->pieceToCharSynonyms[blackPiece]);
-        }
-    };
-    for (auto const &[name, variant] : SF::variants) {
-        if (t == IsPromotable::PROMOTABLE) {
-            copy(variant->promotionPieceTypes[0], variant);
-            copy(variant->promotionPieceTypes[1], variant);
-        } else {
-            copy(variant->pieceTypes, variant);
-        }
-    }
-    std::string retVal;
-    retVal.resize(pieces.size());
-    std::copy(pieces.begin(), pieces.end(), retVal.begin());
-    return retVal;
+std::string_view fairystockfish::pieceChars(std::string_view variantName) {
+    return variantPieceChars(variantName).all;
 }
 
-std::string fairystockfish::availablePieceChars() {
-    return availablePieceChars__impl(IsPromotable::ALL);
+std::string_view fairystockfish::promotablePieceChars(std::string_view variantName) {
+    return variantPieceChars(variantName).promotable;
 }
 
-std::string fairystockfish::availablePromotablePieceChars() {
-    return availablePieceChars__impl(IsPromotable::PROMOTABLE);
+fairystockfish::VariantInfo fairystockfish::variantInfo(std::string variantName) {
+    auto registry = internal::variantRegistry();
+    auto it       = registry->info.find(variantName);
+    if (it == registry->info.end())
+        throw std::runtime_error("Unknown variant: '" + variantName + "'");
+    return it->second;
+}
+
+std::vector<fairystockfish::VariantInfo> fairystockfish::allVariantInfo() {
+    auto registry = internal::variantRegistry();
+    std::vector<VariantInfo> all;
+    all.reserve(registry->info.size());
+    for (auto const &[name, info] : registry->info) all.push_back(info);
+    return all;
 }
 
 bool fairystockfish::validateFEN(std::string variantName, std::string fen, bool isChess960) {
     return FenValidation::FEN_OK
-        == SF::FEN::validate_fen(fen, SF::variants.find(variantName)->second, isChess960);
+        == SF::FEN::validate_fen(fen, internal::findVariant(variantName).get(), isChess960);
 }
 
 // NOTE: This is certainly not the "best" way to convert these moves
@@ -182,7 +642,7 @@ fairystockfish::to960Uci(std::string variantName, std::vector<std::string> moves
     // Example differences: e8g8 -> e8h8
     // Example differences: e1c1 -> e1a1
     // Example differences: e8c8 -> e8a8
-    const SF::Variant *variant = SF::variants.find(variantName)->second;
+    auto variant = internal::findVariant(variantName);
 
     // If the variant doesn't support castling, then there is no
     // translation to be done.
@@ -284,12 +744,16 @@ fairystockfish::to960Uci(std::string variantName, std::vector<std::string> moves
 }
 
 void fairystockfish::Position::init(std::string startingFen, bool _isChess960) {
-    Stockfish::Variant const *v = Stockfish::variants.find(std::string(variant))->second;
-
     auto newState = std::make_shared<StateNode>();
 
     std::shared_ptr<Stockfish::Position> p = std::make_shared<Stockfish::Position>();
-    p->set(v, startingFen, isChess960, &newState->stateInfo, Stockfish::Threads.main());
+    p->set(
+        sfVariant.get(),
+        startingFen,
+        isChess960,
+        &newState->stateInfo,
+        internal::positionThread()
+    );
     position = p;
     state    = newState;
 }
@@ -297,18 +761,17 @@ void fairystockfish::Position::init(std::string startingFen, bool _isChess960) {
 fairystockfish::Position::Position(std::string _variant, bool _isChess960)
     : variant(_variant)
     , isChess960(_isChess960)
-    , position{} {
-    // TODO: make this safer (throw an exception?)
-    Stockfish::Variant const *v = Stockfish::variants.find(variant)->second;
-
-    std::string fen = v->startFen;
+    , position{}
+    , sfVariant{internal::findVariant(_variant)} {
+    std::string fen = sfVariant->startFen;
     init(fen, _isChess960);
 }
 
 fairystockfish::Position::Position(std::string _variant, std::string startingFen, bool _isChess960)
     : variant(_variant)
     , isChess960(_isChess960)
-    , position{} {
+    , position{}
+    , sfVariant{internal::findVariant(_variant)} {
     init(startingFen, _isChess960);
 }
 
@@ -370,7 +833,7 @@ std::vector<std::string> fairystockfish::Position::getSANMoves(
 ) const {
     Stockfish::Notation notation = fromOurNotation(ourNotation);
     if (notation == Stockfish::NOTATION_DEFAULT)
-        notation = Stockfish::default_notation(Stockfish::variants.find(variant)->second);
+        notation = Stockfish::default_notation(sfVariant.get());
 
     // make a copy of the previous states
     // TODO: this copy may be pessimistic. I'd need to understand _why_
@@ -404,6 +867,8 @@ std::string fairystockfish::Position::getFEN(bool sFen, bool showPromoted, int c
     return position->fen(sFen, showPromoted, countStarted);
 }
 
+std::uint64_t fairystockfish::Position::key() const { return position->key(); }
+
 bool fairystockfish::Position::givesCheck() const { return position->checkers() ? true : false; }
 
 int fairystockfish::Position::gameResult() const {
@@ -443,7 +908,7 @@ bool fairystockfish::Position::hasRepeated() const { return position->has_repeat
 
 std::map<std::string, fairystockfish::Piece> fairystockfish::Position::piecesOnUciBoard() const {
     std::map<std::string, Piece> retVal;
-    Stockfish::Variant const *v = Stockfish::variants[variant];
+    Stockfish::Variant const *v = sfVariant.get();
 
     for (Stockfish::File f = Stockfish::File::FILE_A; f <= v->maxFile; ++f) {
         for (Stockfish::Rank r = Stockfish::Rank::RANK_1; r <= v->maxRank; ++r) {
@@ -466,10 +931,16 @@ std::map<std::string, fairystockfish::Piece> fairystockfish::Position::piecesOnU
     return retVal;
 }
 
+// The public Square keeps the 12 file layout of large board builds, the engine's
+// own squares are only 8 files wide without LARGEBOARDS.
+static fairystockfish::Square _publicSquare(SF::File f, SF::Rank r) {
+    return static_cast<fairystockfish::Square>(int(r) * int(fairystockfish::SQ_A2) + int(f));
+}
+
 std::map<fairystockfish::Square, fairystockfish::Piece> fairystockfish::Position::piecesOnBoard(
 ) const {
     std::map<Square, Piece> retVal;
-    Stockfish::Variant const *v = Stockfish::variants[variant];
+    Stockfish::Variant const *v = sfVariant.get();
 
     for (Stockfish::File f = Stockfish::File::FILE_A; f <= v->maxFile; ++f) {
         for (Stockfish::Rank r = Stockfish::Rank::RANK_1; r <= v->maxRank; ++r) {
@@ -485,7 +956,7 @@ std::map<fairystockfish::Square, fairystockfish::Piece> fairystockfish::Position
             Stockfish::PieceType pt = type_of(p);
             Stockfish::Color c      = color_of(p);
 
-            retVal.insert({static_cast<Square>(s), fairystockfish::Piece(pt, c, promoted)});
+            retVal.insert({_publicSquare(f, r), fairystockfish::Piece(pt, c, promoted)});
         }
     }
     return retVal;
@@ -508,17 +979,139 @@ std::vector<fairystockfish::Piece> fairystockfish::Position::piecesInHand() cons
     return retVal;
 }
 
+static std::uint64_t perft(SF::Position &pos, int depth) {
+    SF::MoveList<SF::LEGAL> moves(pos);
+    if (depth <= 1) return moves.size();
+    SF::StateInfo st;
+    std::uint64_t nodes = 0;
+    for (auto const &m : moves) {
+        pos.do_move(m, st);
+        nodes += perft(pos, depth - 1);
+        pos.undo_move(m);
+    }
+    return nodes;
+}
+
+std::uint64_t fairystockfish::perft(Position const &position, int depth) {
+    if (depth <= 0) return 1;
+    auto pos = internal::PositionAccess::copy(position);
+    return ::perft(*pos, depth);
+}
+
 std::map<fairystockfish::Square, bool> fairystockfish::Position::wallsOnBoard() const {
     std::map<Square, bool> retVal;
-    Stockfish::Variant const *v = Stockfish::variants[variant];
+    Stockfish::Variant const *v = sfVariant.get();
 
     for (Stockfish::File f = Stockfish::File::FILE_A; f <= v->maxFile; ++f) {
         for (Stockfish::Rank r = Stockfish::Rank::RANK_1; r <= v->maxRank; ++r) {
             Stockfish::Square s = make_square(f, r);
             if ((position->pieces() & s) && position->empty(s)) {
-                retVal.insert({static_cast<Square>(s), true});
+                retVal.insert({_publicSquare(f, r), true});
             }
         }
     }
     return retVal;
 }
+
+// The threads of evaluateBatch()'s workers. Not the search threads: those keep
+// state of their last search (e.g. trend, which the classical evaluation reads)
+// that would make the scores depend on earlier searches. Grown on demand with
+// engineMutex() held and deliberately leaked, like positionThread().
+static std::vector<SF::Thread *> _evaluationThreads;
+static std::size_t const _maxEvaluationThreads = 512;  // The maximum of "Threads"
+
+static SF::Thread *evaluationThread(std::size_t worker) {
+    while (_evaluationThreads.size() <= worker) {
+        auto *th  = new SF::Thread(_evaluationThreads.size());
+        th->trend = SF::SCORE_ZERO;
+        _evaluationThreads.push_back(th);
+    }
+    return _evaluationThreads[worker];
+}
+
+// The variant must be kept alive by the caller.
+static fairystockfish::BatchEvaluationStats evaluateFENs(
+    SF::Variant const *v,
+    std::vector<std::string> const &fens,
+    std::vector<int> &scores,
+    int threads,
+    bool isChess960
+) {
+    std::lock_guard<std::mutex> guard(fairystockfish::internal::engineMutex());
+    fairystockfish::internal::claimEngine();
+    fairystockfish::internal::activateVariant(v);
+    scores.assign(fens.size(), fairystockfish::VALUE_NONE);
+
+    std::size_t workers = threads > 0 ? std::size_t(threads) : SF::Threads.size();
+    workers = std::min(workers, _maxEvaluationThreads);
+    workers = std::max<std::size_t>(1, std::min(workers, fens.size()));
+    for (std::size_t worker = 0; worker < workers; ++worker) evaluationThread(worker);
+
+    // Workers grab chunks of positions so that uneven positions (or uneven
+    // cores) don't leave anybody idle at the end.
+    constexpr std::size_t chunkSize = 256;
+    std::atomic<std::size_t> next{0};
+    auto work = [&](std::size_t worker) {
+        SF::Thread *th = _evaluationThreads[worker];
+        SF::Position pos;
+        SF::StateInfo st;
+        std::size_t begin;
+        while ((begin = next.fetch_add(chunkSize)) < fens.size()) {
+            std::size_t end = std::min(begin + chunkSize, fens.size());
+            for (std::size_t i = begin; i < end; ++i) {
+                pos.set(v, fens[i], isChess960, &st, th);
+                scores[i]
+                    = pos.checkers() ? fairystockfish::VALUE_NONE : int(SF::Eval::evaluate(pos));
+            }
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> helpers;
+    for (std::size_t worker = 1; worker < workers; ++worker) helpers.emplace_back(work, worker);
+    work(0);
+    for (auto &helper : helpers) helper.join();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    fairystockfish::BatchEvaluationStats stats;
+    stats.positions          = fens.size();
+    stats.seconds            = elapsed.count();
+    stats.positionsPerSecond = stats.seconds > 0 ? double(stats.positions) / stats.seconds : 0.0;
+    return stats;
+}
+
+
+fairystockfish::BatchEvaluationStats fairystockfish::evaluateBatch(
+    std::string variantName,
+    std::vector<std::string> const &fens,
+    std::vector<int> &scores,
+    int threads,
+    bool isChess960
+) {
+    auto v = internal::findVariant(variantName);
+    return evaluateFENs(v.get(), fens, scores, threads, isChess960);
+}
+
+fairystockfish::BatchEvaluationStats fairystockfish::evaluateBatch(
+    std::vector<Position> const &positions,
+    std::vector<int> &scores,
+    int threads
+) {
+    if (positions.empty()) {
+        scores.clear();
+        return BatchEvaluationStats{};
+    }
+
+    // By the positions' own variant, which loadVariantConfig() may have
+    // redefined since they were made.
+    auto const &first = positions.front();
+    auto const &v     = internal::PositionAccess::variant(first);
+    std::vector<std::string> fens;
+    fens.reserve(positions.size());
+    for (auto const &position : positions) {
+        if (internal::PositionAccess::variant(position) != v)
+            throw std::runtime_error("evaluateBatch: all positions must be of the same variant");
+        fens.push_back(position.getFEN());
+    }
+    return evaluateFENs(v.get(), fens, scores, threads, first.isChess960);
+}
@@ -16,16 +16,19 @@
 #include "variant.h"
 
 #include <climits>
+#include <future>
 #include <list>
 #include <map>
 #include <memory>
 #include <sstream>
+#include <string_view>
 #include <vector>
 
 namespace fairystockfish {
 using FenValidation = Stockfish::FEN::FenValidation;
 
-// Copied from the types.h
+// Copied from the types.h of large board builds. Libraries built without
+// LARGEBOARDS use the same values, squares are translated by file and rank.
 enum Square : std::uint8_t {
     SQ_A1,
     SQ_B1,
@@ -176,6 +179,7 @@ enum Notation : std::uint8_t {
 extern int const VALUE_ZERO;
 extern int const VALUE_DRAW;
 extern int const VALUE_MATE;
+extern int const VALUE_NONE;
 
 struct PieceInfo {
   private:
@@ -209,10 +213,64 @@ struct Piece {
     int id() const { return _pieceInfo.id(); };
 };
 
+///------------------------------------------------------------------------------
+/// How long a phase of init() took.
+///------------------------------------------------------------------------------
+struct InitPhase {
+    std::string name;
+    double ms = 0;
+};
+
+///------------------------------------------------------------------------------
+/// What init() did, phase by phase.
+///------------------------------------------------------------------------------
+struct InitReport {
+    std::vector<InitPhase> phases;
+    double totalMs = 0;
+    // Whether the search phases (bitbases, endgames, search tables, threads)
+    // have run yet, they are deferred by a lazy init().
+    bool searchReady = false;
+};
+
 ///------------------------------------------------------------------------------
 /// Initialize the fairystockfish library.
+///
+/// Throws a std::runtime_error if the host CPU lacks the instruction set the
+/// library was compiled for (see compiledArch()).
+///
+/// @param lazy Defer what only searches and evaluations need (bitbases,
+///             endgames, search tables and the thread pool) until the first of
+///             them, which then pays for it. Positions, move generation and
+///             FEN handling work right away. Only the first call's mode counts.
+///
+/// @return The timings of the phases that ran so far.
 ///------------------------------------------------------------------------------
-void init();
+InitReport init(bool lazy = false);
+
+///------------------------------------------------------------------------------
+/// Returns the timings of the phases of init() that ran so far, including
+/// deferred ones.
+///------------------------------------------------------------------------------
+InitReport initReport();
+
+///------------------------------------------------------------------------------
+/// Readies the library for worker processes forked from this one, call it
+/// right before fork().
+///
+/// Initializes it lazily and precomputes the evaluation tables of every
+/// variant, so that the children share the attack, magic and evaluation
+/// tables copy-on-write instead of each building and keeping its own copy.
+/// It only helps forked children: separately started processes build their
+/// own tables. Sharing the tables between unrelated processes through mapped
+/// files isn't supported, the engine builds them in place in its globals.
+///
+/// The engine threads don't survive a fork(), so if a search already started
+/// them they are stopped. The next search starts them again, in this process
+/// and in each child, with a clear hash table and clear histories. Until then
+/// "Threads" and "Hash" are kept for the restart, and "Clear Hash" has nothing
+/// left to do (the restart clears everything).
+///------------------------------------------------------------------------------
+void prepareFork();
 
 ///------------------------------------------------------------------------------
 /// Return the version of the library.
@@ -221,6 +279,28 @@ void init();
 ///------------------------------------------------------------------------------
 std::string version();
 
+///------------------------------------------------------------------------------
+/// Return the ISA level the library was compiled for, using the ARCH names of
+/// the Fairy-Stockfish Makefile (e.g. "x86-64-avx2"), or "generic".
+///------------------------------------------------------------------------------
+std::string compiledArch();
+
+///------------------------------------------------------------------------------
+/// Return the highest ISA level supported by the host CPU, as detected through
+/// CPUID. Use it to pick which fairystockfish-<arch> library to load.
+///------------------------------------------------------------------------------
+std::string bestSupportedArch();
+
+///------------------------------------------------------------------------------
+/// Return whether the library was compiled with 128 bit bitboards, for boards
+/// larger than 8x8. The fairystockfish-smallboards library isn't, and is faster
+/// on the variants it has: a host that loads both can send a variant to it
+/// whenever it's among its availableVariants(). Both export the same symbols,
+/// the smallboards library has to be loaded with dlopen(RTLD_LOCAL), never with
+/// RTLD_GLOBAL or linked next to the default one.
+///------------------------------------------------------------------------------
+bool largeBoards();
+
 ///------------------------------------------------------------------------------
 /// Print to stdout useful information about the library and enabled variants
 ///------------------------------------------------------------------------------
@@ -231,6 +311,10 @@ void info();
 ///------------------------------------------------------------------------------
 /// Sets one of the UCI options that fairy stockfish supports.
 ///
+/// After a lazy init() or prepareFork(), "Threads" and "Hash" are applied when
+/// the thread pool is created (by the next search or evaluation) rather than
+/// right away.
+///
 /// @param name The name of the parameter to set.
 /// @param value The value of the parameters (in string form)
 ///------------------------------------------------------------------------------
@@ -240,12 +324,34 @@ void setUCIOption(std::string name, std::string value);
 /// Given a string containing .ini style configuration of variants, load them into
 /// the supported variants for Fairy Stockfish.
 ///
+/// The new set of variants is published at once, lookups never see half of a
+/// configuration. Positions created before keep the variant they were created
+/// with, even if the configuration redefines it.
+///
 /// @param config A string containing the ini style variant configuration. Please
 ///               see https://github.com/ianfab/Fairy-Stockfish/blob/master/src/variants.ini
 ///               for example of syntax.
 ///------------------------------------------------------------------------------
 void loadVariantConfig(std::string config);
 
+///------------------------------------------------------------------------------
+/// Loads an NNUE network file and switches evaluation to NNUE.
+///
+/// The network is parsed straight from a read-only mapping of the file, which
+/// saves the read buffer but not the weights: each process still unpacks its
+/// own copy of them, so processes don't share the network's memory.
+///
+/// There is a single network, used by every variant, and loading a file
+/// replaces it. Sharing the unpacked weights between processes or keeping one
+/// network per variant isn't supported: the weights live in the engine's
+/// global network objects, which the library can't place or duplicate.
+///
+/// @param path The path to the .nnue file.
+///
+/// @return Whether the network was loaded.
+///------------------------------------------------------------------------------
+bool loadEvalFile(std::string path);
+
 ///------------------------------------------------------------------------------
 /// Returns the list of names of supported variants.
 ///
@@ -287,6 +393,66 @@ std::string availablePieceChars();
 ///------------------------------------------------------------------------------
 std::string availablePromotablePieceChars();
 
+///------------------------------------------------------------------------------
+/// The piece chars of a variant, upper and lower case, sorted.
+///
+/// The chars are computed when the variant is loaded, the returned view stays
+/// valid for the life of the process.
+///
+/// Throws a std::runtime_error if the variant is unknown.
+///------------------------------------------------------------------------------
+std::string_view pieceChars(std::string_view variantName);
+
+///------------------------------------------------------------------------------
+/// The promotable piece chars of a variant, upper and lower case, sorted.
+///
+/// The chars are computed when the variant is loaded, the returned view stays
+/// valid for the life of the process.
+///
+/// Throws a std::runtime_error if the variant is unknown.
+///------------------------------------------------------------------------------
+std::string_view promotablePieceChars(std::string_view variantName);
+
+///------------------------------------------------------------------------------
+/// A piece type of a variant with its chars.
+///------------------------------------------------------------------------------
+struct VariantPiece {
+    PieceInfo pieceInfo;
+    char whiteChar = ' ';
+    char blackChar = ' ';
+};
+
+///------------------------------------------------------------------------------
+/// What a frontend needs to know about a variant.
+///------------------------------------------------------------------------------
+struct VariantInfo {
+    std::string name;
+    std::string startFen;
+    int files = 0;
+    int ranks = 0;
+    std::vector<VariantPiece> pieces;
+    std::string pieceChars;
+    std::string promotablePieceChars;
+    bool drops    = false;
+    bool gating   = false;
+    bool walls    = false;
+    bool castling = false;
+    bool counting = false;
+};
+
+///------------------------------------------------------------------------------
+/// Describes a variant. The description is computed when the variant is
+/// loaded.
+///
+/// Throws a std::runtime_error if the variant is unknown.
+///------------------------------------------------------------------------------
+VariantInfo variantInfo(std::string variantName);
+
+///------------------------------------------------------------------------------
+/// Describes all of the available variants at once, sorted by name.
+///------------------------------------------------------------------------------
+std::vector<VariantInfo> allVariantInfo();
+
 ///------------------------------------------------------------------------------
 /// Validates an input FEN.
 ///
@@ -308,6 +474,10 @@ bool validateFEN(std::string variantName, std::string fen, bool isChess960 = fal
 ///------------------------------------------------------------------------------
 std::vector<std::string> to960Uci(std::string variantName, std::vector<std::string> moves);
 
+namespace internal {
+struct PositionAccess;
+}
+
 ///------------------------------------------------------------------------------
 /// A position with a specific game variant.
 ///------------------------------------------------------------------------------
@@ -336,6 +506,8 @@ class Position {
         Stockfish::StateInfo stateInfo;
     };
     mutable std::shared_ptr<StateNode> state = nullptr;
+    // Keeps the variant alive when loadVariantConfig() redefines it.
+    std::shared_ptr<Stockfish::Variant const> sfVariant;
 
     // Copy the position
     // NOTE: This depends some things that FairyStockfish may break
@@ -347,6 +519,8 @@ class Position {
 
     void init(std::string startingFen, bool _isChess960 = false);
 
+    friend struct internal::PositionAccess;
+
   public:
     Position(std::string _variant, bool _isChess960 = false);
     Position(std::string _variant, std::string startingFen, bool _isChess960 = false);
@@ -357,6 +531,13 @@ class Position {
     Position &operator=(Position &&)       = default;
     virtual ~Position()                    = default;
 
+    ///------------------------------------------------------------------------------
+    /// Returns the Zobrist hash of the position. It covers the pieces, the side
+    /// to move, castling and en passant rights, pieces in hand, ... but not the
+    /// moves that led to the position.
+    ///------------------------------------------------------------------------------
+    std::uint64_t key() const;
+
     ///------------------------------------------------------------------------------
     /// Returns a new, updated positions with the given moves
     ///------------------------------------------------------------------------------
@@ -507,6 +688,780 @@ class Position {
     ///------------------------------------------------------------------------------
     std::vector<Piece> piecesInHand() const;
 };
+
+///------------------------------------------------------------------------------
+/// Counts the leaves of the tree of legal moves of the given depth (perft),
+/// to check move generation and measure its speed.
+///------------------------------------------------------------------------------
+std::uint64_t perft(Position const &position, int depth);
+
+///------------------------------------------------------------------------------
+/// How long a batch evaluation took.
+///------------------------------------------------------------------------------
+struct BatchEvaluationStats {
+    std::size_t positions     = 0;
+    double seconds            = 0.0;
+    double positionsPerSecond = 0.0;
+};
+
+///------------------------------------------------------------------------------
+/// Statically evaluates many positions in parallel, without searching. This uses
+/// NNUE when a network is loaded (see loadEvalFile) and the classical evaluation
+/// otherwise.
+///
+/// Each worker reuses a single scratch position, so nothing is allocated per
+/// position. The workers have engine threads of their own, kept for later
+/// batches, so a position scores the same whatever was searched before. No
+/// search runs while a batch is being evaluated.
+///
+/// @param variantName The variant of all of the positions.
+/// @param fens The positions to evaluate. They are not validated, see validateFEN.
+/// @param scores Receives one score per FEN from the point of view of the side to
+///               move (in engine units, see VALUE_MATE), or VALUE_NONE for
+///               positions in check.
+/// @param threads The number of workers, at most 512 like "Threads" (the UCI
+///                option). 0 means as many as "Threads".
+/// @param isChess960 Whether the positions are chess960 positions.
+///
+/// @return The number of positions and the throughput.
+///------------------------------------------------------------------------------
+BatchEvaluationStats evaluateBatch(
+    std::string variantName,
+    std::vector<std::string> const &fens,
+    std::vector<int> &scores,
+    int threads     = 0,
+    bool isChess960 = false
+);
+
+///------------------------------------------------------------------------------
+/// Same as above for positions that have already been built. All of the
+/// positions must be of the same variant. They are handed to the workers
+/// through their FEN.
+///------------------------------------------------------------------------------
+BatchEvaluationStats evaluateBatch(
+    std::vector<Position> const &positions,
+    std::vector<int> &scores,
+    int threads = 0
+);
+
+///------------------------------------------------------------------------------
+/// Settings of a self-play run.
+///------------------------------------------------------------------------------
+struct SelfPlayOptions {
+    std::string variant = "chess";
+    // The position games start from, the variant's start position when empty.
+    std::string startFen = "";
+    bool isChess960      = false;
+
+    int games = 1;
+    // Search limits of every move, at least one of them must be set (0 means
+    // unset, negative values are rejected with a std::invalid_argument).
+    int nodes = 10'000;
+    int depth = 0;
+    // Number of uniformly random moves played before searching starts.
+    int randomPlies = 8;
+    // Games still running after this many plies (at most 65535) are
+    // adjudicated as draws.
+    int maxPlies = 400;
+    std::uint64_t seed = 0;
+};
+
+///------------------------------------------------------------------------------
+/// Summary of a self-play run.
+///------------------------------------------------------------------------------
+struct SelfPlayStats {
+    int games                 = 0;
+    int whiteWins             = 0;
+    int blackWins             = 0;
+    int draws                 = 0;
+    std::size_t positions     = 0;
+    double seconds            = 0.0;
+    double positionsPerSecond = 0.0;
+};
+
+///------------------------------------------------------------------------------
+/// One training sample read back from a self-play file.
+///------------------------------------------------------------------------------
+struct SelfPlayRecord {
+    std::string fen;
+    // The search score and the final result (1 win, 0 draw, -1 loss), both from
+    // the point of view of the side to move.
+    int score;
+    int result;
+};
+
+///------------------------------------------------------------------------------
+/// Plays games of the engine against itself and streams them to a file.
+///
+/// Moves are searched with the "Threads" engine threads, so a run uses all the
+/// cores the engine is configured for. Games end on checkmate/stalemate, on
+/// isImmediateGameEnd and on isOptionalGameEnd (repetitions, move counting
+/// rules, ...).
+///
+/// The file is written one game at a time: a header ("FSSP", a version, the
+/// variant and chess960 flag), then per game its starting FEN, its result, and
+/// for every ply the UCI move and the search score. Positions are recovered by
+/// replaying the moves, see readSelfPlayFile.
+///
+/// @param options The variant, number of games and search limits.
+/// @param outputPath The file to (over)write.
+///
+/// @return The results and throughput of the run.
+///------------------------------------------------------------------------------
+SelfPlayStats selfPlay(SelfPlayOptions const &options, std::string outputPath);
+
+///------------------------------------------------------------------------------
+/// Reads a file written by selfPlay back into one record per searched position.
+///------------------------------------------------------------------------------
+std::vector<SelfPlayRecord> readSelfPlayFile(std::string path);
+
+///------------------------------------------------------------------------------
+/// Uses the Syzygy tablebases found in `path` (directories separated by ':', or
+/// ';' on Windows), the same as the "SyzygyPath" option. Table files are mapped
+/// the first time they are probed and stay mapped until the tables are
+/// reinitialized: by a new path, or by setting the "SyzygyPath" or "Clear Hash"
+/// options. Probes running on other threads wait for those to finish.
+///
+/// @param path Where the table files are, "<empty>" turns the tables off.
+/// @param useInSearch Whether searches use the tables as well, including to
+///                    rank the root moves.
+///
+/// @return The largest number of pieces the tables cover, 0 if none were found.
+///------------------------------------------------------------------------------
+int initTablebases(std::string path, bool useInSearch = true);
+
+///------------------------------------------------------------------------------
+/// Probes the win/draw/loss tables.
+///
+/// Only chess positions without castling rights and with few enough pieces can
+/// be probed.
+///
+/// @return Whether the probe succeeded and the result from the point of view of
+///         the side to move: 2 win, 1 win prevented by the 50 move rule, 0 draw,
+///         -1 loss saved by the 50 move rule, -2 loss.
+///------------------------------------------------------------------------------
+std::tuple<bool, int> probeWDL(Position const &position);
+
+///------------------------------------------------------------------------------
+/// Probes the distance to zeroing tables.
+///
+/// @return Whether the probe succeeded and the number of plies to the next
+///         capture or pawn move of the best line, positive when the side to move
+///         wins and negative when it loses (0 for draws), the same as
+///         Fairy-Stockfish's probe_dtz.
+///------------------------------------------------------------------------------
+std::tuple<bool, int> probeDTZ(Position const &position);
+
+///------------------------------------------------------------------------------
+/// probeWDL for many positions at once, spread over `threads` threads (0 means
+/// one per core). Positions of other variants just fail.
+///------------------------------------------------------------------------------
+std::vector<std::tuple<bool, int>>
+probeWDLBatch(std::vector<Position> const &positions, int threads = 0);
+
+///------------------------------------------------------------------------------
+/// The state of a game clock, all times are in milliseconds.
+///------------------------------------------------------------------------------
+struct Clock {
+    int wtime     = 0;
+    int btime     = 0;
+    int winc      = 0;
+    int binc      = 0;
+    int byoyomi   = 0;
+    int movestogo = 0;
+};
+
+///------------------------------------------------------------------------------
+/// The outcome of a search.
+///------------------------------------------------------------------------------
+struct SearchResult {
+    // In UCI notation, bestMove is empty when there was no legal move.
+    std::string bestMove;
+    std::string ponderMove;
+    std::vector<std::string> pv;
+    // From the point of view of the side to move, in engine units (see VALUE_MATE).
+    int score           = 0;
+    int depth           = 0;
+    int selDepth        = 0;
+    std::uint64_t nodes = 0;
+    int timeMs          = 0;
+};
+
+///------------------------------------------------------------------------------
+/// How well played moves fit their clocks, see Engine::clockStats.
+///------------------------------------------------------------------------------
+struct ClockStats {
+    std::uint64_t moves        = 0;
+    std::uint64_t timeForfeits = 0;
+    std::uint64_t totalTimeMs  = 0;
+};
+
+///------------------------------------------------------------------------------
+/// A move of an opening book and how often it was played.
+///------------------------------------------------------------------------------
+struct BookMove {
+    std::string move;
+    std::uint32_t weight = 0;
+};
+
+///------------------------------------------------------------------------------
+/// A point of the sampled depth timeline of a search, see SearchStats: the
+/// completed depth, time and nodes as of the first sample that saw that depth.
+///------------------------------------------------------------------------------
+struct SearchIteration {
+    int depth           = 0;
+    int timeMs          = 0;
+    std::uint64_t nodes = 0;
+};
+
+///------------------------------------------------------------------------------
+/// What a search did, see Engine::lastSearchStats and Engine::currentSearchStats.
+///------------------------------------------------------------------------------
+struct SearchStats {
+    bool running         = false;
+    std::uint64_t nodes  = 0;
+    std::uint64_t nps    = 0;
+    int depth            = 0;
+    int selDepth         = 0;
+    std::uint64_t tbHits = 0;
+    // Permille of the hash table in use. Fairy-Stockfish doesn't count hash
+    // probes and hits, this is the closest it has.
+    int hashfull = 0;
+    // Summed over the threads, since the time manager last consumed them: over
+    // the last iteration for timed searches, over the whole search otherwise.
+    std::uint64_t bestMoveChanges = 0;
+    int timeMs                    = 0;
+    std::vector<std::uint64_t> threadNodes;
+    // Only recorded while sampling, see Engine::setSearchSampling. A sampled
+    // timeline: iterations completed between two samples only show up as the
+    // last of them, with the time and nodes of the sample.
+    std::vector<SearchIteration> iterations;
+};
+
+///------------------------------------------------------------------------------
+/// Process wide search counters, see Engine::searchTotals.
+///------------------------------------------------------------------------------
+struct SearchTotals {
+    std::uint64_t searches = 0;
+    std::uint64_t nodes    = 0;
+    std::uint64_t tbHits   = 0;
+    std::uint64_t timeMs   = 0;
+};
+
+///------------------------------------------------------------------------------
+/// The outcome of a mate search, see Engine::findMate.
+///------------------------------------------------------------------------------
+struct MateResult {
+    bool found      = false;
+    int movesToMate = 0;
+    // The mating line in UCI notation, starting with the side to move's move.
+    // It can stop short of the mate when the rest came from the hash table.
+    std::vector<std::string> line;
+    std::uint64_t nodes = 0;
+};
+
+///------------------------------------------------------------------------------
+/// How long a batch of mate searches took, see Engine::findMates.
+///------------------------------------------------------------------------------
+struct MateSearchStats {
+    std::size_t positions     = 0;
+    std::size_t mates         = 0;
+    double seconds            = 0;
+    double positionsPerSecond = 0;
+};
+
+///------------------------------------------------------------------------------
+/// The search engine.
+///
+/// Fairy-Stockfish has a single search (thread pool, transposition table, ...)
+/// per process, so all the members are static and calls are serialized.
+///------------------------------------------------------------------------------
+class Engine {
+  public:
+    ///------------------------------------------------------------------------------
+    /// Chooses a move for the side to move with the engine's time manager, which
+    /// takes increments, byo-yomi and moves to go into account.
+    ///
+    /// Throws a std::runtime_error if the side to move has no time at all.
+    ///
+    /// @param position The current position, including its move history.
+    /// @param clock The clock state before the move.
+    ///
+    /// @return The chosen move and search information.
+    ///------------------------------------------------------------------------------
+    static SearchResult play(Position const &position, Clock const &clock);
+
+    ///------------------------------------------------------------------------------
+    /// Starts searching, in the background, the position the opponent is expected
+    /// to reach, like the UCI "go ponder" command. The search keeps going until
+    /// ponderHit() or stopPondering(); anything else that needs the engine
+    /// (another search, setting options, ...) aborts it first.
+    ///
+    /// @param expected The current position with the expected reply played, i.e.
+    ///                 with us to move.
+    /// @param clock Our clock as it will be when the expected reply is played.
+    ///------------------------------------------------------------------------------
+    static void ponder(Position const &expected, Clock const &clock);
+
+    ///------------------------------------------------------------------------------
+    /// The opponent played the expected move: turns the ponder search into a
+    /// normal one, keeping what it found so far, and returns its result once the
+    /// time manager stops it.
+    ///
+    /// Throws a std::runtime_error when not pondering.
+    ///------------------------------------------------------------------------------
+    static SearchResult ponderHit();
+
+    ///------------------------------------------------------------------------------
+    /// The opponent played another move: aborts the ponder search, if any, and
+    /// drops its result.
+    ///------------------------------------------------------------------------------
+    static void stopPondering();
+
+    ///------------------------------------------------------------------------------
+    /// Whether a ponder search is waiting for ponderHit() or stopPondering().
+    ///------------------------------------------------------------------------------
+    static bool isPondering();
+
+    ///------------------------------------------------------------------------------
+    /// Saves the hash table and the history tables of the search threads (main,
+    /// capture, continuation, counter move and gate history) to a file, so that
+    /// a restarted process can pick up where this one left off
+    /// (see loadState). The file is a raw dump of the tables, as big as the
+    /// "Hash" option, for the same build of the library on the same kind of host.
+    ///------------------------------------------------------------------------------
+    static void saveState(std::string path);
+
+    ///------------------------------------------------------------------------------
+    /// Restores the tables saved by saveState, setting "Hash" to the saved size.
+    /// The file is memory mapped and read ahead, then copied with all the cores.
+    ///
+    /// Throws a std::runtime_error if the file wasn't saved by a compatible build.
+    ///------------------------------------------------------------------------------
+    static void loadState(std::string path);
+
+    ///------------------------------------------------------------------------------
+    /// Returns the statistics of the last finished search, whatever started it
+    /// (play, ponderHit, topMoves, findMate, selfPlay, ...).
+    ///------------------------------------------------------------------------------
+    static SearchStats lastSearchStats();
+
+    ///------------------------------------------------------------------------------
+    /// Samples running searches every intervalMs milliseconds on a thread of its
+    /// own, which records the depth timeline as of each sample (the engine has
+    /// no hook at the end of an iteration) and makes currentSearchStats() follow
+    /// the search. 0 (the default) turns sampling off.
+    ///------------------------------------------------------------------------------
+    static void setSearchSampling(int intervalMs);
+
+    ///------------------------------------------------------------------------------
+    /// Returns the statistics of the running search as of the last sample, to
+    /// stream them from another thread; `running` is false when no search runs.
+    /// This never waits for the search.
+    ///------------------------------------------------------------------------------
+    static SearchStats currentSearchStats();
+
+    ///------------------------------------------------------------------------------
+    /// Returns counters summed over all the finished searches of the process,
+    /// e.g. to export them as metrics. This never waits for the search.
+    ///------------------------------------------------------------------------------
+    static SearchTotals searchTotals();
+
+    ///------------------------------------------------------------------------------
+    /// Resets the counters of searchTotals().
+    ///------------------------------------------------------------------------------
+    static void resetSearchTotals();
+
+    ///------------------------------------------------------------------------------
+    /// Returns how many moves play() made and how many of those used more
+    /// time than the mover had left (which would have lost on time).
+    ///------------------------------------------------------------------------------
+    static ClockStats clockStats();
+
+    ///------------------------------------------------------------------------------
+    /// Resets the counters returned by clockStats().
+    ///------------------------------------------------------------------------------
+    static void resetClockStats();
+
+    ///------------------------------------------------------------------------------
+    /// Returns the `count` best moves and their scores from a MultiPV search of
+    /// `nodes` nodes, for "hint" and "show top moves" features.
+    ///
+    /// The answer only depends on the position (not on the moves that led to
+    /// it), count, nodes and the engine options, so it is the same on every run
+    /// and every host: the search runs on a thread of its own with clear
+    /// histories, skill limits are turned off, and it uses a freshly cleared
+    /// private transposition table of a fixed size. The engine's thread pool and
+    /// shared table are left untouched. Answers are cached, the cache is cleared
+    /// whenever options, networks or variants change. Callers can cache them
+    /// too, using Position::key().
+    ///
+    /// @return Up to `count` lines, best first.
+    ///------------------------------------------------------------------------------
+    static std::vector<SearchResult>
+    topMoves(Position const &position, int count, std::uint64_t nodes);
+
+    ///------------------------------------------------------------------------------
+    /// Scores candidate moves with a single full-strength search restricted to
+    /// them (the UCI "searchmoves"), with one principal variation per candidate,
+    /// instead of one search per move.
+    ///
+    /// Throws a std::runtime_error if a candidate isn't a legal move, and a
+    /// std::invalid_argument if nodes is 0 (the search would never stop).
+    ///
+    /// @param position The position, including its move history.
+    /// @param candidates The moves to score in UCI notation, all the legal moves
+    ///                   when empty.
+    /// @param nodes The node budget of the search.
+    ///
+    /// @return One result per candidate, in the order of the candidates, whose
+    ///         bestMove is the candidate and score its score.
+    ///------------------------------------------------------------------------------
+    static std::vector<SearchResult> rateMoves(
+        Position const &position,
+        std::vector<std::string> const &candidates,
+        std::uint64_t nodes
+    );
+
+    ///------------------------------------------------------------------------------
+    /// Uses the opening book at `path` (see buildBook) for the given variant,
+    /// replacing its previous book. The file is memory mapped read-only, so
+    /// processes using the same book share its pages. The book is only used for
+    /// positions of the variant's current definition, after loadVariantConfig()
+    /// redefines the variant it has to be loaded again.
+    ///
+    /// Throws a std::runtime_error if the file isn't a book for this variant
+    /// and this build of the library.
+    ///------------------------------------------------------------------------------
+    static void loadBook(std::string variantName, std::string path);
+
+    ///------------------------------------------------------------------------------
+    /// Returns a book move for the position, picked at random in proportion to
+    /// the book weights, or an empty string when the position isn't in the book
+    /// of its variant. This doesn't search, it's meant to be called first.
+    ///------------------------------------------------------------------------------
+    static std::string bookMove(Position const &position);
+
+    ///------------------------------------------------------------------------------
+    /// Returns all the book moves for the position, most played first.
+    ///------------------------------------------------------------------------------
+    static std::vector<BookMove> bookMoves(Position const &position);
+
+    ///------------------------------------------------------------------------------
+    /// Looks for a forced mate by the side to move, at full strength. The search
+    /// stops as soon as a mate in at most maxMovesToMate moves is proven, or after
+    /// `nodes` nodes.
+    ///
+    /// @param position The position, including its move history.
+    /// @param maxMovesToMate The longest mate to look for, in moves.
+    /// @param nodes The node budget, it must be positive.
+    ///
+    /// @return The mate and its line, or found == false when there is none within
+    ///         the budget.
+    ///------------------------------------------------------------------------------
+    static MateResult findMate(Position const &position, int maxMovesToMate, std::uint64_t nodes);
+
+    ///------------------------------------------------------------------------------
+    /// findMate over many positions, e.g. to mine puzzles from a game archive.
+    ///
+    /// Positions are searched one after the other, each one with all the
+    /// "Threads" engine threads.
+    ///
+    /// @param results Receives one result per position.
+    ///
+    /// @return The number of positions and mates, and the throughput.
+    ///------------------------------------------------------------------------------
+    static MateSearchStats findMates(
+        std::vector<Position> const &positions,
+        int maxMovesToMate,
+        std::uint64_t nodes,
+        std::vector<MateResult> &results
+    );
+};
+
+///------------------------------------------------------------------------------
+/// Builds an opening book from a game archive and writes it to a file.
+///
+/// The book is a sorted table of (position key, move, weight) entries, the
+/// weight being how often the move was played in that position.
+///
+/// @param variantName The variant of the games.
+/// @param games The games, each one being its UCI moves from the start position.
+/// @param path The file to (over)write.
+/// @param maxPly Only the first maxPly moves of each game are used.
+/// @param minWeight Moves played fewer times than this are left out.
+/// @param startFen The FEN games start from, the variant's start position when empty.
+///
+/// @return The number of (position, move) entries of the book.
+///------------------------------------------------------------------------------
+std::size_t buildBook(
+    std::string variantName,
+    std::vector<std::vector<std::string>> const &games,
+    std::string path,
+    int maxPly              = 20,
+    std::uint32_t minWeight = 1,
+    std::string startFen    = ""
+);
+
+///------------------------------------------------------------------------------
+/// How a reviewed move compares to the engine's choice.
+///------------------------------------------------------------------------------
+enum MoveJudgement : std::uint8_t {
+    JUDGEMENT_BEST,
+    JUDGEMENT_GOOD,
+    JUDGEMENT_INACCURACY,
+    JUDGEMENT_MISTAKE,
+    JUDGEMENT_BLUNDER,
+};
+
+///------------------------------------------------------------------------------
+/// Settings of a game review, see GameReview.
+///------------------------------------------------------------------------------
+struct ReviewOptions {
+    // Search limits of every position, at least one of them must be set.
+    std::uint64_t nodes = 200'000;
+    int depth           = 0;
+    int movetimeMs      = 0;
+    // Size of the review's own hash table, at least 1.
+    std::size_t hashMB = 16;
+    // How much worse than the best move (in engine units, a pawn is about 200)
+    // a move must be to be judged an inaccuracy, a mistake or a blunder.
+    int inaccuracy = 100;
+    int mistake    = 200;
+    int blunder    = 600;
+};
+
+///------------------------------------------------------------------------------
+/// The review of one move of a game.
+///------------------------------------------------------------------------------
+struct PlyReview {
+    // The index of the move in the game, 0 being the first one.
+    int ply = 0;
+    std::string move;
+    std::string bestMove;
+    std::vector<std::string> pv;
+    // Both from the point of view of the player of the move, in engine units.
+    int bestScore           = 0;
+    int playedScore         = 0;
+    MoveJudgement judgement = JUDGEMENT_BEST;
+};
+
+namespace internal {
+struct ReviewState;
+}
+
+///------------------------------------------------------------------------------
+/// Reviews the moves of a game, last to first, one move per call to next(), so
+/// that the reviews can be streamed as they are made.
+///
+/// Analysing the plies in reverse order lets every search use what the search
+/// of the following position left in the hash table. The review has a hash
+/// table of its own, so it stays warm even when other searches run between
+/// calls, and several reviews can be interleaved (e.g. one per thread). Each
+/// call searches with all the "Threads" engine threads; calls are serialized.
+///------------------------------------------------------------------------------
+class GameReview {
+  public:
+    ///------------------------------------------------------------------------------
+    /// Throws a std::runtime_error if the variant is unknown, a move is illegal
+    /// or there are no search limits.
+    ///
+    /// @param variantName The variant of the game.
+    /// @param startFen The position the game starts from, the variant's start
+    ///                 position when empty.
+    /// @param moves The moves of the game in UCI notation.
+    /// @param options Search limits and judgement thresholds.
+    /// @param isChess960 Whether the game is a chess960 game.
+    ///------------------------------------------------------------------------------
+    GameReview(
+        std::string variantName,
+        std::string startFen,
+        std::vector<std::string> const &moves,
+        ReviewOptions const &options = ReviewOptions{},
+        bool isChess960              = false
+    );
+    ~GameReview();
+
+    GameReview(GameReview const &)            = delete;
+    GameReview &operator=(GameReview const &) = delete;
+
+    ///------------------------------------------------------------------------------
+    /// Reviews the latest move that wasn't reviewed yet.
+    ///
+    /// @return false once all the moves have been reviewed.
+    ///------------------------------------------------------------------------------
+    bool next(PlyReview &review);
+
+  private:
+    std::vector<Position> _positions;
+    std::vector<std::string> _moves;
+    ReviewOptions _options;
+    std::unique_ptr<internal::ReviewState> _state;
+};
+
+namespace internal {
+struct SlicedSearchState;
+}
+
+///------------------------------------------------------------------------------
+/// A node-limited search that runs in small slices, so that a few workers can
+/// take turns between many concurrent searches (e.g. weak bots that only need
+/// a few thousand nodes per move) instead of dedicating an engine to each.
+///
+/// A running Fairy-Stockfish search can't be suspended, so every slice is a
+/// short search of its own. The search has a small hash table of its own
+/// though, which keeps what the previous slices found: each slice quickly gets
+/// back to where the last one stopped and goes deeper. Slices are serialized
+/// with every other search, and use the "Threads" engine threads.
+///------------------------------------------------------------------------------
+class SlicedSearch {
+  public:
+    ///------------------------------------------------------------------------------
+    /// @param position The root position, including its move history.
+    /// @param nodes The node budget of the whole search.
+    /// @param quantum The node budget of one slice.
+    /// @param hashMB The size of the search's own hash table.
+    ///------------------------------------------------------------------------------
+    SlicedSearch(
+        Position const &position,
+        std::uint64_t nodes,
+        std::uint64_t quantum = 1'000,
+        std::size_t hashMB    = 1
+    );
+    ~SlicedSearch();
+
+    SlicedSearch(SlicedSearch const &)            = delete;
+    SlicedSearch &operator=(SlicedSearch const &) = delete;
+
+    ///------------------------------------------------------------------------------
+    /// Runs one slice, unless the search is done.
+    ///
+    /// @return Whether the search is done.
+    ///------------------------------------------------------------------------------
+    bool step();
+
+    bool done() const;
+
+    ///------------------------------------------------------------------------------
+    /// The result of the last slice, which is the best result so far.
+    ///------------------------------------------------------------------------------
+    SearchResult const &result() const;
+
+    ///------------------------------------------------------------------------------
+    /// The nodes searched by all the slices so far.
+    ///------------------------------------------------------------------------------
+    std::uint64_t nodes() const;
+
+  private:
+    Position _position;
+    std::uint64_t _budget;
+    std::uint64_t _quantum;
+    std::size_t _hashMB;
+    std::uint64_t _nodes = 0;
+    SearchResult _result;
+    std::unique_ptr<internal::SlicedSearchState> _state;
+};
+
+///------------------------------------------------------------------------------
+/// A bot of a BotPool.
+///------------------------------------------------------------------------------
+struct BotConfig {
+    // Bots play the definition of the variant current when they are created,
+    // see loadVariantConfig().
+    std::string variant = "chess";
+    // The engine's "Skill Level", from 0 (weakest) to 20 (full strength).
+    int skillLevel = 20;
+    // When positive, limits the strength to this Elo (the engine's UCI_Elo)
+    // instead of using skillLevel.
+    int elo = 0;
+    // The nodes searched per move, must be positive.
+    std::uint64_t nodes = 5'000;
+    // The size of the bot's own hash table in MB, like the "Hash" option, at
+    // least 1.
+    std::size_t hashMB = 1;
+};
+
+///------------------------------------------------------------------------------
+/// Load and latency of a BotPool, latencies are from submission to result over
+/// the most recent jobs.
+///------------------------------------------------------------------------------
+struct BotPoolStats {
+    std::uint64_t completed = 0;
+    std::uint64_t rejected  = 0;
+    std::size_t queued      = 0;
+    double p50Ms            = 0;
+    double p99Ms            = 0;
+};
+
+namespace internal {
+struct BotPoolState;
+}
+
+///------------------------------------------------------------------------------
+/// Many bots of varied strength sharing the engine.
+///
+/// Each bot has its own small hash table, so its memory is bounded by its
+/// config. Jobs ("choose a move") go through a bounded queue to a dispatcher
+/// thread, which runs them one after the other on the engine's thread pool
+/// (Fairy-Stockfish has one search per process).
+///------------------------------------------------------------------------------
+class BotPool {
+  public:
+    ///------------------------------------------------------------------------------
+    /// @param maxQueued How many jobs can wait at most, submit() rejects the
+    ///                  others.
+    ///------------------------------------------------------------------------------
+    explicit BotPool(std::size_t maxQueued = 1'024);
+
+    ///------------------------------------------------------------------------------
+    /// Finishes the running job, queued jobs fail with a std::runtime_error.
+    ///------------------------------------------------------------------------------
+    ~BotPool();
+
+    BotPool(BotPool const &)            = delete;
+    BotPool &operator=(BotPool const &) = delete;
+
+    ///------------------------------------------------------------------------------
+    /// Adds a bot. Throws a std::runtime_error if its variant is unknown and a
+    /// std::invalid_argument if its node budget is 0.
+    ///
+    /// @return The id of the bot.
+    ///------------------------------------------------------------------------------
+    int createBot(BotConfig const &config);
+
+    ///------------------------------------------------------------------------------
+    /// Removes a bot, its queued jobs still run.
+    ///------------------------------------------------------------------------------
+    void removeBot(int botId);
+
+    ///------------------------------------------------------------------------------
+    /// Queues a "choose a move" job.
+    ///
+    /// Throws a std::runtime_error if the bot is unknown, if the position isn't
+    /// of its variant or if the queue is full.
+    ///
+    /// @return The move, once chosen.
+    ///------------------------------------------------------------------------------
+    std::future<SearchResult> submit(int botId, Position const &position);
+
+    BotPoolStats stats() const;
+
+  private:
+    std::unique_ptr<internal::BotPoolState> _state;
+};
+
+///------------------------------------------------------------------------------
+/// Reviews a whole game with GameReview, see its constructor for the parameters.
+///
+/// @return The reviews of all the moves, in game order.
+///------------------------------------------------------------------------------
+std::vector<PlyReview> reviewGame(
+    std::string variantName,
+    std::string startFen,
+    std::vector<std::string> const &moves,
+    ReviewOptions const &options = ReviewOptions{},
+    bool isChess960              = false
+);
 }  // namespace fairystockfish
 
 #endif  // FAIRYSTOCKFISH_H
@@ -0,0 +1,236 @@
+#ifndef FAIRYSTOCKFISH_INTERNAL_H
+#define FAIRYSTOCKFISH_INTERNAL_H
+
+// Helpers shared between the translation units of the wrapper. None of this is
+// part of the public API (and javacpp never sees it).
+
+#include "fairystockfish.h"
+
+#include <cstdint>
+#include <istream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+
+namespace fairystockfish {
+namespace internal {
+
+///------------------------------------------------------------------------------
+/// Fairy-Stockfish keeps its thread pool, search limits and evaluation tables
+/// in globals. Anything that uses them (searches, batch evaluation, ...) must
+/// hold this lock.
+///------------------------------------------------------------------------------
+std::mutex &engineMutex();
+
+///------------------------------------------------------------------------------
+/// Guards the Syzygy tablebases: probes hold it shared, anything that can
+/// reinitialize the tables (the "SyzygyPath" and "Clear Hash" options) must
+/// hold it exclusively. Taken after engineMutex().
+///------------------------------------------------------------------------------
+std::shared_mutex &tablebasesMutex();
+
+///------------------------------------------------------------------------------
+/// One published version of the variants.
+///
+/// loadVariants() never changes a published registry or its variants, it
+/// publishes a new registry instead. Each variant is kept alive by the
+/// registries and positions that refer to it and is freed (with engineMutex()
+/// held, see collectRetiredVariants()) once the last of them is gone.
+///------------------------------------------------------------------------------
+struct VariantRegistry {
+    struct PieceChars {
+        std::string_view all;
+        std::string_view promotable;
+    };
+
+    std::uint64_t generation = 0;
+    std::map<std::string, std::shared_ptr<Stockfish::Variant const>, std::less<>> variants;
+    // Computed before the registry is published, the views point to strings
+    // that are never freed.
+    std::map<std::string, PieceChars, std::less<>> pieceChars;
+    PieceChars allPieceChars;
+    std::map<std::string, VariantInfo, std::less<>> info;
+};
+
+///------------------------------------------------------------------------------
+/// The current registry, doesn't need engineMutex().
+///------------------------------------------------------------------------------
+std::shared_ptr<VariantRegistry const> variantRegistry();
+
+///------------------------------------------------------------------------------
+/// Look up a variant by name in the current registry.
+///
+/// Throws a std::runtime_error if the variant is unknown.
+///------------------------------------------------------------------------------
+std::shared_ptr<Stockfish::Variant const> findVariant(std::string const &name);
+
+///------------------------------------------------------------------------------
+/// The variant the engine itself defines under this name, even when
+/// loadVariants() has redefined the name since, or nullptr if there is none.
+///------------------------------------------------------------------------------
+Stockfish::Variant const *builtinVariant(std::string_view name);
+
+///------------------------------------------------------------------------------
+/// Frees the variants that are no longer referred to. Must be called with
+/// engineMutex() held.
+///------------------------------------------------------------------------------
+void collectRetiredVariants();
+
+///------------------------------------------------------------------------------
+/// Make the variant dependent evaluation tables (PSQT and piece values) match
+/// the given variant. Must be called with engineMutex() held.
+///------------------------------------------------------------------------------
+void activateVariant(Stockfish::Variant const *v);
+
+///------------------------------------------------------------------------------
+/// Parse an ini style variant configuration and publish the resulting variants
+/// as a new registry, see loadVariantConfig().
+///------------------------------------------------------------------------------
+void loadVariants(std::istream &config);
+
+///------------------------------------------------------------------------------
+/// The Fairy-Stockfish thread that the wrapper's positions are bound to.
+///
+/// It's not part of the engine's thread pool, so positions stay valid when the
+/// pool is resized (e.g. through the "Threads" option).
+///------------------------------------------------------------------------------
+Stockfish::Thread *positionThread();
+
+///------------------------------------------------------------------------------
+/// Gives the wrapper's other translation units access to the Fairy-Stockfish
+/// position behind a fairystockfish::Position.
+///------------------------------------------------------------------------------
+struct PositionAccess {
+    static Stockfish::Position const &sf(Position const &p) { return *p.position; }
+    static Stockfish::StateInfo const &stateInfo(Position const &p) { return p.state->stateInfo; }
+    // The variant the position was made with, which loadVariants() may have
+    // redefined since.
+    static std::shared_ptr<Stockfish::Variant const> const &variant(Position const &p) {
+        return p.sfVariant;
+    }
+    static std::shared_ptr<Stockfish::Position> copy(Position const &p) {
+        return p.copyPosition(p.position);
+    }
+    // The position set up again from the given FEN, without the moves that led
+    // to it but with its own variant.
+    static Position fromFEN(Position const &p, std::string const &fen) {
+        Position root = p;
+        root.init(fen, p.isChess960);
+        return root;
+    }
+};
+
+///------------------------------------------------------------------------------
+/// Starts a search on the engine's thread pool and returns immediately,
+/// aborting a ponder search first. Must be called with engineMutex() held.
+///
+/// @param position The root position, including the history used for
+///                 repetition detection.
+/// @param limits The search limits, startTime is set here.
+/// @param ponderMode Whether to start the search in ponder mode.
+///------------------------------------------------------------------------------
+void startSearch(
+    Position const &position,
+    Stockfish::Search::LimitsType limits,
+    bool ponderMode = false
+);
+
+///------------------------------------------------------------------------------
+/// Aborts the search started by Engine::ponder, if it's still running. Must be
+/// called with engineMutex() held before anything that uses the thread pool or
+/// changes what the search reads (options, variants, networks, ...).
+///------------------------------------------------------------------------------
+void stopPondering();
+
+///------------------------------------------------------------------------------
+/// Readies the engine for the caller: finishes a lazy init() and aborts a
+/// ponder search. Must be called with engineMutex() held before anything that
+/// uses the thread pool, the hash table or the evaluation.
+///------------------------------------------------------------------------------
+void claimEngine();
+
+///------------------------------------------------------------------------------
+/// Waits for the running search and returns the thread whose root moves hold
+/// the result, following the same rules the engine uses for "bestmove".
+///------------------------------------------------------------------------------
+Stockfish::Thread *waitForSearch();
+
+///------------------------------------------------------------------------------
+/// Converts a root move of a finished search into a SearchResult.
+///
+/// @param th The thread returned by waitForSearch().
+/// @param position The root position of the search.
+/// @param index Which root move, the first one is the best move.
+///------------------------------------------------------------------------------
+SearchResult
+searchResult(Stockfish::Thread const *th, Position const &position, std::size_t index = 0);
+
+///------------------------------------------------------------------------------
+/// What Search::clear() does (clears the hash table and the histories of the
+/// pool's threads), without reinitializing the tablebases under the probes.
+/// Must be called with engineMutex() held and no search running.
+///------------------------------------------------------------------------------
+void clearSearch();
+
+///------------------------------------------------------------------------------
+/// Forgets cached search results, for when something that influences the
+/// search (options, networks, variants) changes. Must be called with
+/// engineMutex() held.
+///------------------------------------------------------------------------------
+void clearSearchCaches();
+
+///------------------------------------------------------------------------------
+/// The size of the engine's transposition table in bytes, measured through
+/// TT.first_entry() since the size of a cluster is private to the engine. Must
+/// be called with engineMutex() held.
+///------------------------------------------------------------------------------
+std::size_t hashTableBytes();
+
+///------------------------------------------------------------------------------
+/// Puts a private transposition table in place of the engine's global one for
+/// its lifetime. The search only ever reaches its table through the global
+/// `TT` object, so this gives a search a table of its own while the shared one
+/// is left untouched.
+///
+/// Must be used with engineMutex() held and no search running.
+///------------------------------------------------------------------------------
+class ScopedTT {
+  public:
+    explicit ScopedTT(Stockfish::TranspositionTable &tt);
+    ~ScopedTT();
+
+    ScopedTT(ScopedTT const &)            = delete;
+    ScopedTT &operator=(ScopedTT const &) = delete;
+
+  private:
+    Stockfish::TranspositionTable &_tt;
+};
+
+///------------------------------------------------------------------------------
+/// Searches at full strength, and with the given MultiPV, for its lifetime
+/// whatever the user set the strength options to. Must be used with
+/// engineMutex() held.
+///------------------------------------------------------------------------------
+class FullStrength {
+  public:
+    explicit FullStrength(int multiPV = 1);
+    ~FullStrength();
+
+    FullStrength(FullStrength const &)            = delete;
+    FullStrength &operator=(FullStrength const &) = delete;
+
+  private:
+    static std::string option(char const *name);
+
+    std::string _multiPV;
+    std::string _skillLevel;
+    std::string _limitStrength;
+};
+
+}  // namespace internal
+}  // namespace fairystockfish
+
+#endif  // FAIRYSTOCKFISH_INTERNAL_H
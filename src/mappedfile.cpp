@@ -0,0 +1,74 @@
+#include "mappedfile.h"
+
+#include <fstream>
+#include <iterator>
+#include <utility>
+
+#if !defined(_WIN32)
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
+
+fairystockfish::MappedFile::MappedFile(std::string const &path) {
+#if !defined(_WIN32)
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) return;
+
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *p = ::mmap(nullptr, std::size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) {
+            _data   = static_cast<char const *>(p);
+            _size   = std::size_t(st.st_size);
+            _mapped = true;
+        }
+    }
+    // The mapping keeps its own reference to the file.
+    ::close(fd);
+#else
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return;
+    _buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    if (_buffer.empty()) return;
+    _data = _buffer.data();
+    _size = _buffer.size();
+#endif
+}
+
+fairystockfish::MappedFile::MappedFile(MappedFile &&other) noexcept { *this = std::move(other); }
+
+fairystockfish::MappedFile &fairystockfish::MappedFile::operator=(MappedFile &&other) noexcept {
+    if (this != &other) {
+        close();
+        _buffer       = std::move(other._buffer);
+        _data         = other._mapped ? other._data : (_buffer.empty() ? nullptr : _buffer.data());
+        _size         = other._size;
+        _mapped       = other._mapped;
+        other._data   = nullptr;
+        other._size   = 0;
+        other._mapped = false;
+    }
+    return *this;
+}
+
+fairystockfish::MappedFile::~MappedFile() { close(); }
+
+void fairystockfish::MappedFile::willNeed() const {
+#if !defined(_WIN32)
+    if (!_mapped) return;
+    ::madvise(const_cast<char *>(_data), _size, MADV_SEQUENTIAL);
+    ::madvise(const_cast<char *>(_data), _size, MADV_WILLNEED);
+#endif
+}
+
+void fairystockfish::MappedFile::close() {
+#if !defined(_WIN32)
+    if (_mapped) ::munmap(const_cast<char *>(_data), _size);
+#endif
+    _buffer.clear();
+    _data   = nullptr;
+    _size   = 0;
+    _mapped = false;
+}
@@ -0,0 +1,63 @@
+#ifndef FAIRYSTOCKFISH_MAPPEDFILE_H
+#define FAIRYSTOCKFISH_MAPPEDFILE_H
+
+#include <cstddef>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace fairystockfish {
+
+///------------------------------------------------------------------------------
+/// A read-only view of a whole file.
+///
+/// On POSIX systems the file is mapped with MAP_SHARED, so every process that
+/// maps the same file is backed by the same page cache pages. Elsewhere we fall
+/// back to reading the file into a private buffer.
+///
+/// NOTE: This is an internal helper, it's not part of the public API.
+///------------------------------------------------------------------------------
+class MappedFile {
+  public:
+    MappedFile() = default;
+    explicit MappedFile(std::string const &path);
+
+    MappedFile(MappedFile const &)            = delete;
+    MappedFile &operator=(MappedFile const &) = delete;
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+    ~MappedFile();
+
+    bool isOpen() const { return _data != nullptr; }
+    char const *data() const { return _data; }
+    std::size_t size() const { return _size; }
+
+    ///------------------------------------------------------------------------------
+    /// Hint to the kernel that the whole file is about to be read front to back.
+    ///------------------------------------------------------------------------------
+    void willNeed() const;
+
+  private:
+    void close();
+
+    char const *_data = nullptr;
+    std::size_t _size = 0;
+    bool _mapped      = false;
+    std::vector<char> _buffer;
+};
+
+///------------------------------------------------------------------------------
+/// A std::streambuf reading directly from a block of memory, so that APIs that
+/// want an std::istream can read a MappedFile without copying it.
+///------------------------------------------------------------------------------
+class MemoryStreamBuf : public std::streambuf {
+  public:
+    MemoryStreamBuf(char const *data, std::size_t size) {
+        char *begin = const_cast<char *>(data);
+        setg(begin, begin, begin + size);
+    }
+};
+
+}  // namespace fairystockfish
+
+#endif  // FAIRYSTOCKFISH_MAPPEDFILE_H
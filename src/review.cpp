@@ -0,0 +1,131 @@
+#include "internal.h"
+
+#include <algorithm>
+
+namespace SF = Stockfish;
+
+struct fairystockfish::internal::ReviewState {
+    // A value initialized table has no memory yet, the first search sizes it.
+    SF::TranspositionTable tt{};
+    bool fresh = true;
+    // The next move to review, counting down.
+    int next = 0;
+    // The score of the position after that move, from the point of view of the
+    // side to move there.
+    int nextScore = 0;
+};
+
+namespace {
+
+// The result of a finished game from the point of view of the side to move.
+bool gameOver(fairystockfish::Position const &pos, int &result) {
+    if (pos.getLegalMoves().empty()) {
+        result = pos.gameResult();
+        return true;
+    }
+    auto [immediateEnd, immediateResult] = pos.isImmediateGameEnd();
+    result                               = immediateResult;
+    return immediateEnd;
+}
+
+fairystockfish::SearchResult
+search(fairystockfish::Position const &pos, fairystockfish::ReviewOptions const &options) {
+    SF::Search::LimitsType limits;
+    limits.nodes    = std::int64_t(options.nodes);
+    limits.depth    = options.depth;
+    limits.movetime = options.movetimeMs;
+    fairystockfish::internal::startSearch(pos, limits);
+    return fairystockfish::internal::searchResult(fairystockfish::internal::waitForSearch(), pos);
+}
+
+fairystockfish::MoveJudgement judge(
+    fairystockfish::PlyReview const &review,
+    fairystockfish::ReviewOptions const &options
+) {
+    if (review.move == review.bestMove) return fairystockfish::JUDGEMENT_BEST;
+    // A deeper look at the played move can find it better than the best one.
+    int loss = std::max(review.bestScore - review.playedScore, 0);
+    if (loss >= options.blunder) return fairystockfish::JUDGEMENT_BLUNDER;
+    if (loss >= options.mistake) return fairystockfish::JUDGEMENT_MISTAKE;
+    if (loss >= options.inaccuracy) return fairystockfish::JUDGEMENT_INACCURACY;
+    return fairystockfish::JUDGEMENT_GOOD;
+}
+
+}  // namespace
+
+fairystockfish::GameReview::GameReview(
+    std::string variantName,
+    std::string startFen,
+    std::vector<std::string> const &moves,
+    ReviewOptions const &options,
+    bool isChess960
+)
+    : _moves{moves}
+    , _options{options}
+    , _state{std::make_unique<internal::ReviewState>()} {
+    if (options.nodes == 0 && options.depth <= 0 && options.movetimeMs <= 0)
+        throw std::runtime_error("GameReview: no search limits");
+
+    _positions.push_back(
+        startFen.empty() ? Position(variantName, isChess960)
+                         : Position(variantName, startFen, isChess960)
+    );
+    for (auto const &move : moves) {
+        auto legalMoves = _positions.back().getLegalMoves();
+        if (std::find(legalMoves.begin(), legalMoves.end(), move) == legalMoves.end())
+            throw std::runtime_error("GameReview: illegal move " + move);
+        _positions.push_back(_positions.back().makeMoves({move}));
+    }
+    _state->next = int(moves.size()) - 1;
+}
+
+fairystockfish::GameReview::~GameReview() = default;
+
+bool fairystockfish::GameReview::next(PlyReview &review) {
+    if (_state->next < 0) return false;
+
+    std::lock_guard<std::mutex> guard(internal::engineMutex());
+    internal::claimEngine();
+    internal::ScopedTT scopedTT(_state->tt);
+    internal::FullStrength fullStrength;
+
+    if (_state->fresh) {
+        // Allocates (and clears) the review's own table. The histories belong to
+        // the shared threads, they are left alone.
+        SF::TT.resize(std::max<std::size_t>(_options.hashMB, 1));
+
+        // The final position, which no move of the game is reviewed from.
+        Position const &last = _positions.back();
+        int result           = 0;
+        _state->nextScore    = gameOver(last, result) ? result : search(last, _options).score;
+        _state->fresh        = false;
+    }
+
+    int ply            = _state->next;
+    SearchResult best  = search(_positions[std::size_t(ply)], _options);
+    review.ply         = ply;
+    review.move        = _moves[std::size_t(ply)];
+    review.bestMove    = best.bestMove;
+    review.pv          = best.pv;
+    review.bestScore   = best.score;
+    review.playedScore = review.move == best.bestMove ? best.score : -_state->nextScore;
+    review.judgement   = judge(review, _options);
+
+    _state->nextScore = best.score;
+    --_state->next;
+    return true;
+}
+
+std::vector<fairystockfish::PlyReview> fairystockfish::reviewGame(
+    std::string variantName,
+    std::string startFen,
+    std::vector<std::string> const &moves,
+    ReviewOptions const &options,
+    bool isChess960
+) {
+    GameReview gameReview(variantName, startFen, moves, options, isChess960);
+    std::vector<PlyReview> reviews(moves.size());
+    PlyReview review;
+    while (gameReview.next(review)) reviews[std::size_t(review.ply)] = review;
+    return reviews;
+}
@@ -0,0 +1,221 @@
+#include "internal.h"
+#include "mappedfile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+
+namespace SF = Stockfish;
+
+static char const _selfPlayMagic[4]         = {'F', 'S', 'S', 'P'};
+static std::uint16_t const _selfPlayVersion = 1;
+
+namespace {
+
+struct Ply {
+    std::string move;
+    std::int16_t score;
+};
+
+// Little endian writers/readers, so files can move between hosts.
+template <typename T>
+void write(std::ostream &out, T value) {
+    char bytes[sizeof(T)];
+    for (std::size_t i = 0; i < sizeof(T); ++i)
+        bytes[i] = char((std::uint64_t(value) >> (8 * i)) & 0xFF);
+    out.write(bytes, sizeof(T));
+}
+
+template <typename Length>
+void writeString(std::ostream &out, std::string const &s) {
+    write<Length>(out, Length(s.size()));
+    out.write(s.data(), std::streamsize(s.size()));
+}
+
+struct Reader {
+    char const *data;
+    std::size_t size;
+    std::size_t offset = 0;
+
+    template <typename T>
+    T read() {
+        if (offset + sizeof(T) > size) throw std::runtime_error("Truncated self-play file");
+        std::uint64_t value = 0;
+        for (std::size_t i = 0; i < sizeof(T); ++i)
+            value |= std::uint64_t(std::uint8_t(data[offset + i])) << (8 * i);
+        offset += sizeof(T);
+        return T(value);
+    }
+
+    template <typename Length>
+    std::string readString() {
+        std::size_t length = read<Length>();
+        if (offset + length > size) throw std::runtime_error("Truncated self-play file");
+        std::string s(data + offset, length);
+        offset += length;
+        return s;
+    }
+};
+
+SF::Color sideToMove(fairystockfish::Position const &pos) {
+    return fairystockfish::internal::PositionAccess::sf(pos).side_to_move();
+}
+
+// Returns whether the game is over, and if so its result from the point of
+// view of the side to move.
+bool isGameOver(fairystockfish::Position const &pos, int &result) {
+    if (pos.getLegalMoves().empty()) {
+        result = pos.gameResult();
+        return true;
+    }
+    auto [immediateEnd, immediateResult] = pos.isImmediateGameEnd();
+    if (immediateEnd) {
+        result = immediateResult;
+        return true;
+    }
+    auto [optionalEnd, optionalResult] = pos.isOptionalGameEnd();
+    if (optionalEnd) {
+        result = optionalResult;
+        return true;
+    }
+    return false;
+}
+
+int sign(int value) { return (value > 0) - (value < 0); }
+
+// Plays the random opening moves, retrying when they happen to end the game.
+fairystockfish::Position randomOpening(
+    fairystockfish::SelfPlayOptions const &options,
+    std::mt19937_64 &rng
+) {
+    fairystockfish::Position start
+        = options.startFen.empty()
+            ? fairystockfish::Position(options.variant, options.isChess960)
+            : fairystockfish::Position(options.variant, options.startFen, options.isChess960);
+
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        fairystockfish::Position pos = start;
+        int result                   = 0;
+        bool gameOver                = false;
+        for (int ply = 0; ply < options.randomPlies && !gameOver; ++ply) {
+            auto moves = pos.getLegalMoves();
+            if (moves.empty()) break;  // The start position is already over
+            std::uniform_int_distribution<std::size_t> pick(0, moves.size() - 1);
+            pos      = pos.makeMoves({moves[pick(rng)]});
+            gameOver = isGameOver(pos, result);
+        }
+        if (!gameOver) return pos;
+    }
+    return start;
+}
+
+}  // namespace
+
+fairystockfish::SelfPlayStats
+fairystockfish::selfPlay(SelfPlayOptions const &options, std::string outputPath) {
+    if (options.nodes < 0 || options.depth < 0)
+        throw std::invalid_argument("selfPlay: nodes and depth can't be negative");
+    if (options.nodes <= 0 && options.depth <= 0)
+        throw std::runtime_error("selfPlay: either nodes or depth must be set");
+    internal::findVariant(options.variant);
+
+    std::ofstream out(outputPath, std::ios::binary | std::ios::trunc);
+    if (!out) throw std::runtime_error("selfPlay: cannot open '" + outputPath + "'");
+    out.write(_selfPlayMagic, sizeof(_selfPlayMagic));
+    write<std::uint16_t>(out, _selfPlayVersion);
+    writeString<std::uint16_t>(out, options.variant);
+    write<std::uint8_t>(out, options.isChess960);
+
+    SF::Search::LimitsType limits;
+    limits.nodes = options.nodes;
+    limits.depth = options.depth;
+
+    // Games are stored with a 16 bit ply count.
+    int const maxPlies = std::min<int>(options.maxPlies, UINT16_MAX);
+
+    std::mt19937_64 rng(options.seed);
+    SelfPlayStats stats;
+    auto start = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> guard(internal::engineMutex());
+    internal::claimEngine();
+    std::vector<Ply> plies;
+    for (int game = 0; game < options.games; ++game) {
+        Position const opening = randomOpening(options, rng);
+        Position pos           = opening;
+        plies.clear();
+
+        // Games are independent, like a "ucinewgame" between them.
+        internal::clearSearch();
+
+        int result = 0;
+        while (!isGameOver(pos, result)) {
+            if (int(plies.size()) >= maxPlies) {
+                result = VALUE_DRAW;
+                break;
+            }
+            internal::startSearch(pos, limits);
+            SF::Search::RootMove const &best = internal::waitForSearch()->rootMoves[0];
+
+            std::string move = SF::UCI::move(internal::PositionAccess::sf(pos), best.pv[0]);
+            int score        = std::clamp<int>(best.score, INT16_MIN, INT16_MAX);
+            plies.push_back({move, std::int16_t(score)});
+            pos = pos.makeMoves({move});
+        }
+
+        // Store the result from white's point of view.
+        int whiteResult = sideToMove(pos) == SF::WHITE ? sign(result) : -sign(result);
+        writeString<std::uint16_t>(out, opening.getFEN());
+        write<std::int8_t>(out, std::int8_t(whiteResult));
+        write<std::uint16_t>(out, std::uint16_t(plies.size()));
+        for (auto const &ply : plies) {
+            writeString<std::uint8_t>(out, ply.move);
+            write<std::int16_t>(out, ply.score);
+        }
+        out.flush();
+
+        ++stats.games;
+        stats.positions += plies.size();
+        if (whiteResult > 0) ++stats.whiteWins;
+        else if (whiteResult < 0) ++stats.blackWins;
+        else ++stats.draws;
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    stats.seconds                         = elapsed.count();
+    stats.positionsPerSecond = stats.seconds > 0 ? double(stats.positions) / stats.seconds : 0.0;
+    return stats;
+}
+
+std::vector<fairystockfish::SelfPlayRecord> fairystockfish::readSelfPlayFile(std::string path) {
+    MappedFile file(path);
+    if (!file.isOpen()) throw std::runtime_error("Cannot read self-play file '" + path + "'");
+
+    Reader in{file.data(), file.size()};
+    if (file.size() < sizeof(_selfPlayMagic)
+        || std::memcmp(file.data(), _selfPlayMagic, sizeof(_selfPlayMagic)) != 0)
+        throw std::runtime_error("'" + path + "' is not a self-play file");
+    in.offset = sizeof(_selfPlayMagic);
+    if (in.read<std::uint16_t>() != _selfPlayVersion)
+        throw std::runtime_error("Unsupported self-play file version in '" + path + "'");
+    std::string variant = in.readString<std::uint16_t>();
+    bool isChess960     = in.read<std::uint8_t>();
+
+    std::vector<SelfPlayRecord> records;
+    while (in.offset < in.size) {
+        Position pos(variant, in.readString<std::uint16_t>(), isChess960);
+        int whiteResult = in.read<std::int8_t>();
+        int plyCount    = in.read<std::uint16_t>();
+        for (int i = 0; i < plyCount; ++i) {
+            std::string move = in.readString<std::uint8_t>();
+            int score        = in.read<std::int16_t>();
+            int result       = sideToMove(pos) == SF::WHITE ? whiteResult : -whiteResult;
+            records.push_back({pos.getFEN(), score, result});
+            pos = pos.makeMoves({move});
+        }
+    }
+    return records;
+}
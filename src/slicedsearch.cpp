@@ -0,0 +1,50 @@
+#include "internal.h"
+
+#include <algorithm>
+
+namespace SF = Stockfish;
+
+struct fairystockfish::internal::SlicedSearchState {
+    // A value initialized table has no memory yet, the first slice sizes it.
+    SF::TranspositionTable tt{};
+};
+
+fairystockfish::SlicedSearch::SlicedSearch(
+    Position const &position,
+    std::uint64_t nodes,
+    std::uint64_t quantum,
+    std::size_t hashMB
+)
+    : _position{position}
+    , _budget{nodes}
+    , _quantum{std::max<std::uint64_t>(quantum, 1)}
+    , _hashMB{std::max<std::size_t>(hashMB, 1)}
+    , _state{std::make_unique<internal::SlicedSearchState>()} {}
+
+fairystockfish::SlicedSearch::~SlicedSearch() = default;
+
+bool fairystockfish::SlicedSearch::step() {
+    if (done()) return true;
+
+    std::lock_guard<std::mutex> guard(internal::engineMutex());
+    internal::claimEngine();
+    internal::ScopedTT scopedTT(_state->tt);
+    if (_nodes == 0) SF::TT.resize(_hashMB);
+
+    SF::Search::LimitsType limits;
+    limits.nodes = std::int64_t(std::min(_quantum, _budget - _nodes));
+    internal::startSearch(_position, limits);
+    _result = internal::searchResult(internal::waitForSearch(), _position);
+    // A search with no legal move doesn't search any node.
+    std::uint64_t used = std::max<std::uint64_t>(_result.nodes, 1);
+    _nodes             = _result.bestMove.empty() ? _budget : std::min(_budget, _nodes + used);
+    return done();
+}
+
+bool fairystockfish::SlicedSearch::done() const { return _nodes >= _budget; }
+
+fairystockfish::SearchResult const &fairystockfish::SlicedSearch::result() const {
+    return _result;
+}
+
+std::uint64_t fairystockfish::SlicedSearch::nodes() const { return _nodes; }
@@ -0,0 +1,100 @@
+#include "internal.h"
+
+#include <algorithm>
+#include <atomic>
+#include <shared_mutex>
+#include <thread>
+
+#include "syzygy/tbprobe.h"
+
+namespace SF = Stockfish;
+namespace TB = Stockfish::Tablebases;
+
+// Probes only read the tables (files are mapped on first use and then stay
+// mapped), initTablebases() and the options that reinitialize them replace
+// them. See internal::tablebasesMutex().
+static std::shared_mutex _tablebasesMutex;
+
+std::shared_mutex &fairystockfish::internal::tablebasesMutex() { return _tablebasesMutex; }
+
+namespace {
+
+// Only the engine's own chess follows the rules the tables were made for, not
+// a variant that redefines "chess".
+bool probeable(SF::Position const &pos) {
+    return pos.variant() == fairystockfish::internal::builtinVariant("chess")
+        && TB::MaxCardinality > 0 && pos.count<SF::ALL_PIECES>() <= TB::MaxCardinality
+        && !pos.can_castle(SF::ANY_CASTLING);
+}
+
+std::tuple<bool, int> probeWDL(SF::Position &pos) {
+    TB::ProbeState state;
+    TB::WDLScore wdl = TB::probe_wdl(pos, &state);
+    return state == TB::FAIL ? std::make_tuple(false, 0) : std::make_tuple(true, int(wdl));
+}
+
+}  // namespace
+
+int fairystockfish::initTablebases(std::string path, bool useInSearch) {
+    std::lock_guard<std::mutex> guard(internal::engineMutex());
+    std::unique_lock<std::shared_mutex> tablebases(_tablebasesMutex);
+    internal::stopPondering();
+
+    // Setting "SyzygyPath" reinitializes the tables and drops their mappings,
+    // only do it when the path changes (setUCIOption() may have changed it).
+    if (path != std::string(SF::Options["SyzygyPath"])) SF::Options["SyzygyPath"] = path;
+    // The search probes up to SyzygyProbeLimit pieces, 0 keeps it away from
+    // the tables (including at the root) while direct probes still work.
+    SF::Options["SyzygyProbeLimit"] = std::to_string(useInSearch ? 7 : 0);
+    internal::clearSearchCaches();
+    return TB::MaxCardinality;
+}
+
+std::tuple<bool, int> fairystockfish::probeWDL(Position const &position) {
+    std::shared_lock<std::shared_mutex> tablebases(_tablebasesMutex);
+    if (!probeable(internal::PositionAccess::sf(position))) return {false, 0};
+    auto pos = internal::PositionAccess::copy(position);
+    return ::probeWDL(*pos);
+}
+
+std::tuple<bool, int> fairystockfish::probeDTZ(Position const &position) {
+    std::shared_lock<std::shared_mutex> tablebases(_tablebasesMutex);
+    if (!probeable(internal::PositionAccess::sf(position))) return {false, 0};
+    auto pos = internal::PositionAccess::copy(position);
+    TB::ProbeState state;
+    int dtz = TB::probe_dtz(*pos, &state);
+    return state == TB::FAIL ? std::make_tuple(false, 0) : std::make_tuple(true, dtz);
+}
+
+std::vector<std::tuple<bool, int>>
+fairystockfish::probeWDLBatch(std::vector<Position> const &positions, int threads) {
+    std::vector<std::tuple<bool, int>> results(positions.size(), {false, 0});
+    if (positions.empty()) return results;
+
+    std::shared_lock<std::shared_mutex> tablebases(_tablebasesMutex);
+    std::size_t workers = threads > 0 ? std::size_t(threads) : std::thread::hardware_concurrency();
+    workers             = std::max<std::size_t>(1, std::min(workers, positions.size()));
+
+    // Probes that hit the disk take much longer than those that don't, so
+    // workers grab small chunks.
+    constexpr std::size_t chunkSize = 16;
+    std::atomic<std::size_t> next{0};
+    auto work = [&] {
+        std::size_t begin;
+        while ((begin = next.fetch_add(chunkSize)) < positions.size()) {
+            std::size_t end = std::min(begin + chunkSize, positions.size());
+            for (std::size_t i = begin; i < end; ++i) {
+                Position const &position = positions[i];
+                if (!probeable(internal::PositionAccess::sf(position))) continue;
+                auto pos   = internal::PositionAccess::copy(position);
+                results[i] = ::probeWDL(*pos);
+            }
+        }
+    };
+
+    std::vector<std::thread> helpers;
+    for (std::size_t worker = 1; worker < workers; ++worker) helpers.emplace_back(work);
+    work();
+    for (auto &helper : helpers) helper.join();
+    return results;
+}
@@ -0,0 +1,33 @@
+#include "fairystockfish.h"
+#include "internal.h"
+#include "thread.h"
+
+#include <doctest.h>
+
+#include <mutex>
+
+// A binary of its own: the library must not have been initialized before.
+TEST_CASE("A lazy init keeps Threads and Hash until the first search") {
+    auto report = fairystockfish::init(true);
+    REQUIRE(!report.searchReady);
+
+    fairystockfish::setUCIOption("Threads", "2");
+    fairystockfish::setUCIOption("Hash", "2");
+    fairystockfish::setUCIOption("Clear Hash", "");
+    REQUIRE(!fairystockfish::initReport().searchReady);
+    REQUIRE(Stockfish::Threads.empty());
+
+    // Positions don't need the search phases.
+    REQUIRE(!fairystockfish::Position("chess").getLegalMoves().empty());
+    REQUIRE(!fairystockfish::initReport().searchReady);
+
+    auto results = fairystockfish::Engine::rateMoves(fairystockfish::Position("chess"), {}, 1'000);
+    REQUIRE(!results.empty());
+    REQUIRE(fairystockfish::initReport().searchReady);
+
+    std::lock_guard<std::mutex> guard(fairystockfish::internal::engineMutex());
+    CHECK(Stockfish::Threads.size() == 2);
+    std::size_t tableBytes = fairystockfish::internal::hashTableBytes();
+    CHECK(tableBytes <= 2 * 1024 * 1024);
+    CHECK(tableBytes > 1024 * 1024);
+}
@@ -1,12 +1,22 @@
 #include "fairystockfish.h"
+#include "internal.h"
 #include "types.h"
+#include "uci.h"
 
 #include <doctest.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <stdexcept>
+#include <thread>
 
+#ifdef LARGEBOARDS
 static std::vector<std::string> variants = {"shogi", "xiangqi"};
+#endif
 
 TEST_CASE("Calling init a bazillion times shouldn't do much") {
     for (int i = 0; i < 10'000; ++i) {
@@ -14,6 +24,28 @@ TEST_CASE("Calling init a bazillion times shouldn't do much") {
     }
 }
 
+TEST_CASE("The host supports the compiled ISA level") {
+    fairystockfish::init();
+    auto const best = fairystockfish::bestSupportedArch();
+    REQUIRE(!best.empty());
+    if (fairystockfish::compiledArch() != "generic") REQUIRE(best != "generic");
+}
+
+TEST_CASE("The library has the test build's board size") {
+    fairystockfish::init();
+#ifdef LARGEBOARDS
+    REQUIRE(fairystockfish::largeBoards());
+    REQUIRE(fairystockfish::variantInfo("xiangqi").files == 9);
+#else
+    REQUIRE(!fairystockfish::largeBoards());
+    for (auto const &info : fairystockfish::allVariantInfo()) {
+        REQUIRE(info.files <= 8);
+        REQUIRE(info.ranks <= 8);
+    }
+#endif
+}
+
+#ifdef LARGEBOARDS
 TEST_CASE("fairystockfish variant setup stuff") {
     fairystockfish::init();
 
@@ -61,6 +93,7 @@ TEST_CASE("fairystockfish variant setup stuff") {
         }
     }
 }
+#endif
 
 TEST_CASE("availablePieceChars") {
     fairystockfish::init();
@@ -71,6 +104,682 @@ TEST_CASE("availablePieceChars") {
     REQUIRE(pieces.find('S') != std::string::npos);
 }
 
+TEST_CASE("piecesOnBoard uses the same squares with either board size") {
+    fairystockfish::init();
+    auto pieces = fairystockfish::Position("chess").makeMoves({"e2e4"}).piecesOnBoard();
+    REQUIRE(pieces.size() == 32);
+    REQUIRE(pieces.count(fairystockfish::SQ_E2) == 0);
+    REQUIRE(pieces.count(fairystockfish::SQ_E4) == 1);
+    CHECK(pieces.at(fairystockfish::SQ_E4).id() == Stockfish::PAWN);
+    CHECK(pieces.at(fairystockfish::SQ_E4).isWhite());
+    CHECK(pieces.at(fairystockfish::SQ_E1).id() == Stockfish::KING);
+    CHECK(pieces.at(fairystockfish::SQ_H1).id() == Stockfish::ROOK);
+    CHECK(pieces.at(fairystockfish::SQ_A8).id() == Stockfish::ROOK);
+    CHECK(pieces.at(fairystockfish::SQ_A8).isBlack());
+    CHECK(pieces.at(fairystockfish::SQ_D8).id() == Stockfish::QUEEN);
+    CHECK(fairystockfish::Position("chess").wallsOnBoard().empty());
+}
+
+TEST_CASE("pieceChars") {
+    fairystockfish::init();
+    CHECK(fairystockfish::pieceChars("chess") == "BKNPQRbknpqr");
+    CHECK(fairystockfish::promotablePieceChars("chess") == "BNQRbnqr");
+    // The same chars are the same view.
+    CHECK(fairystockfish::pieceChars("chess").data() == fairystockfish::pieceChars("chess").data());
+    CHECK_THROWS_AS(fairystockfish::pieceChars("no-such-variant"), std::runtime_error);
+
+    auto all = fairystockfish::availablePieceChars();
+    for (char c : fairystockfish::pieceChars("makruk")) CHECK(all.find(c) != std::string::npos);
+}
+
+TEST_CASE("variantInfo") {
+    fairystockfish::init();
+    auto chess = fairystockfish::variantInfo("chess");
+    CHECK(chess.name == "chess");
+    CHECK(chess.startFen == fairystockfish::initialFen("chess"));
+    CHECK(chess.files == 8);
+    CHECK(chess.ranks == 8);
+    CHECK(chess.pieces.size() == 6);
+    CHECK(chess.pieceChars == "BKNPQRbknpqr");
+    CHECK(chess.castling);
+    CHECK(!chess.drops);
+    CHECK(fairystockfish::variantInfo("crazyhouse").drops);
+    CHECK(fairystockfish::variantInfo("makruk").counting);
+    CHECK_THROWS_AS(fairystockfish::variantInfo("no-such-variant"), std::runtime_error);
+
+    auto all = fairystockfish::allVariantInfo();
+    CHECK(all.size() == fairystockfish::availableVariants().size());
+}
+
+TEST_CASE("loadEvalFile fails cleanly for a missing network") {
+    fairystockfish::init();
+    REQUIRE(!fairystockfish::loadEvalFile("this-network-does-not-exist.nnue"));
+}
+
+TEST_CASE("evaluateBatch") {
+    fairystockfish::init();
+    std::vector<std::string> fens{
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBN1 w Qkq - 0 1",
+        "rnb1kbnr/pppp1ppp/8/4p3/5PPq/8/PPPPP2P/RNBQKBNR w KQkq - 1 3",
+    };
+    std::vector<int> scores;
+    auto stats = fairystockfish::evaluateBatch("chess", fens, scores, 1);
+    REQUIRE(stats.positions == fens.size());
+    REQUIRE(scores.size() == fens.size());
+
+    SUBCASE("Material matters") { REQUIRE(scores[0] > scores[1]); }
+
+    SUBCASE("Positions in check are not evaluated") {
+        REQUIRE(scores[2] == fairystockfish::VALUE_NONE);
+    }
+
+    SUBCASE("More workers than search threads give the same scores") {
+        std::vector<std::string> many;
+        for (int i = 0; i < 1'000; ++i) many.push_back(fens[i % 2]);
+        std::vector<int> parallelScores;
+        fairystockfish::evaluateBatch("chess", many, parallelScores, 4);
+        for (std::size_t i = 0; i < many.size(); ++i) REQUIRE(parallelScores[i] == scores[i % 2]);
+    }
+
+    SUBCASE("Searches don't change the scores") {
+        fairystockfish::Clock clock;
+        clock.wtime = clock.btime = 500;
+        fairystockfish::Engine::play(fairystockfish::Position("chess", fens[1]), clock);
+        std::vector<int> after;
+        fairystockfish::evaluateBatch("chess", fens, after, 1);
+        REQUIRE(after == scores);
+    }
+
+    SUBCASE("Positions can be given directly") {
+        std::vector<fairystockfish::Position> positions{fairystockfish::Position("chess", fens[0])};
+        std::vector<int> positionScores;
+        fairystockfish::evaluateBatch(positions, positionScores);
+        REQUIRE(positionScores == std::vector<int>{scores[0]});
+    }
+}
+
+TEST_CASE("selfPlay round trips through readSelfPlayFile") {
+    fairystockfish::init();
+    fairystockfish::SelfPlayOptions options;
+    options.variant     = "chess";
+    options.games       = 2;
+    options.nodes       = 500;
+    options.randomPlies = 4;
+    options.maxPlies    = 6;
+    options.seed        = 42;
+
+    std::string path = "selfplay_test.bin";
+    auto stats       = fairystockfish::selfPlay(options, path);
+    REQUIRE(stats.games == 2);
+    REQUIRE(stats.whiteWins + stats.blackWins + stats.draws == 2);
+
+    auto records = fairystockfish::readSelfPlayFile(path);
+    REQUIRE(records.size() == stats.positions);
+    for (auto const &record : records) {
+        REQUIRE(fairystockfish::validateFEN("chess", record.fen));
+        REQUIRE(record.result >= -1);
+        REQUIRE(record.result <= 1);
+    }
+    std::remove(path.c_str());
+}
+
+TEST_CASE("selfPlay rejects negative limits") {
+    fairystockfish::init();
+    fairystockfish::SelfPlayOptions options;
+    options.depth = 2;
+    options.nodes = -1;
+    REQUIRE_THROWS_AS(fairystockfish::selfPlay(options, "unused.bin"), std::invalid_argument);
+    options.nodes = 500;
+    options.depth = -1;
+    REQUIRE_THROWS_AS(fairystockfish::selfPlay(options, "unused.bin"), std::invalid_argument);
+}
+
+TEST_CASE("selfPlay from a finished position") {
+    fairystockfish::init();
+    fairystockfish::SelfPlayOptions options;
+    options.variant  = "chess";
+    options.startFen = "7k/6Q1/6K1/8/8/8/8/8 b - - 0 1";  // Black is mated
+    options.games    = 1;
+    options.nodes    = 100;
+
+    std::string path = "selfplay_mated_test.bin";
+    auto stats       = fairystockfish::selfPlay(options, path);
+    REQUIRE(stats.games == 1);
+    REQUIRE(stats.positions == 0);
+    REQUIRE(stats.whiteWins == 1);
+    std::remove(path.c_str());
+}
+
+TEST_CASE("Engine::play respects the clock") {
+    fairystockfish::init();
+    fairystockfish::Engine::resetClockStats();
+    auto position = fairystockfish::Position("chess");
+
+    fairystockfish::Clock clock;
+    clock.wtime = clock.btime = 2'000;
+    clock.winc = clock.binc = 20;
+    auto result             = fairystockfish::Engine::play(position, clock);
+
+    auto legalMoves = position.getLegalMoves();
+    REQUIRE(std::find(legalMoves.begin(), legalMoves.end(), result.bestMove) != legalMoves.end());
+    REQUIRE(result.timeMs < clock.wtime);
+
+    auto stats = fairystockfish::Engine::clockStats();
+    REQUIRE(stats.moves == 1);
+    REQUIRE(stats.timeForfeits == 0);
+
+    SUBCASE("A flagged side cannot move") {
+        REQUIRE_THROWS(fairystockfish::Engine::play(position, fairystockfish::Clock{}));
+    }
+}
+
+TEST_CASE("Engine::topMoves is reproducible") {
+    fairystockfish::init();
+    auto position = fairystockfish::Position("chess").makeMoves({"e2e4", "e7e5"});
+
+    auto first = fairystockfish::Engine::topMoves(position, 3, 20'000);
+    REQUIRE(first.size() == 3);
+    REQUIRE(first[0].score >= first[1].score);
+    REQUIRE(first[1].score >= first[2].score);
+
+    // Drops the cache, so the search runs again.
+    fairystockfish::setUCIOption("Move Overhead", "10");
+    auto second = fairystockfish::Engine::topMoves(position, 3, 20'000);
+    REQUIRE(second.size() == first.size());
+    for (std::size_t i = 0; i < first.size(); ++i) {
+        REQUIRE(second[i].bestMove == first[i].bestMove);
+        REQUIRE(second[i].score == first[i].score);
+        REQUIRE(second[i].pv == first[i].pv);
+    }
+
+    SUBCASE("The history doesn't matter, only the position") {
+        auto fromFen = fairystockfish::Position("chess", position.getFEN());
+        REQUIRE(fromFen.key() == position.key());
+        auto third = fairystockfish::Engine::topMoves(fromFen, 3, 20'000);
+        REQUIRE(third[0].bestMove == first[0].bestMove);
+    }
+
+    SUBCASE("The size of the thread pool doesn't matter") {
+        fairystockfish::setUCIOption("Threads", "2");
+        auto fourth = fairystockfish::Engine::topMoves(position, 3, 20'000);
+        fairystockfish::setUCIOption("Threads", "1");
+        REQUIRE(fourth.size() == first.size());
+        for (std::size_t i = 0; i < first.size(); ++i) {
+            REQUIRE(fourth[i].bestMove == first[i].bestMove);
+            REQUIRE(fourth[i].score == first[i].score);
+        }
+    }
+}
+
+TEST_CASE("Opening books") {
+    fairystockfish::init();
+    std::vector<std::vector<std::string>> games = {
+        {"e2e4", "e7e5", "g1f3"},
+        {"e2e4", "c7c5"},
+        {"d2d4", "d7d5"},
+    };
+    std::string path = "book_test.bin";
+    REQUIRE(fairystockfish::buildBook("chess", games, path, 2) == 5);
+    fairystockfish::Engine::loadBook("chess", path);
+
+    auto start = fairystockfish::Position("chess");
+    auto moves = fairystockfish::Engine::bookMoves(start);
+    REQUIRE(moves.size() == 2);
+    REQUIRE(moves[0].move == "e2e4");
+    REQUIRE(moves[0].weight == 2);
+    REQUIRE(moves[1].move == "d2d4");
+
+    auto move = fairystockfish::Engine::bookMove(start);
+    REQUIRE((move == "e2e4" || move == "d2d4"));
+    REQUIRE(fairystockfish::Engine::bookMove(start.makeMoves({"e2e4", "e7e5"})).empty());
+
+    SUBCASE("A book only serves its variant") {
+        REQUIRE(fairystockfish::Engine::bookMove(fairystockfish::Position("makruk")).empty());
+        REQUIRE_THROWS(fairystockfish::Engine::loadBook("makruk", path));
+    }
+    std::remove(path.c_str());
+}
+
+TEST_CASE("Tablebase probes fail cleanly without tables") {
+    fairystockfish::init();
+    REQUIRE(fairystockfish::initTablebases("<empty>") == 0);
+
+    auto position = fairystockfish::Position("chess", "8/8/8/8/8/4k3/8/4K2Q w - - 0 1");
+    REQUIRE(std::get<0>(fairystockfish::probeWDL(position)) == false);
+    REQUIRE(std::get<0>(fairystockfish::probeDTZ(position)) == false);
+
+    auto results = fairystockfish::probeWDLBatch({position, fairystockfish::Position("chess")}, 2);
+    REQUIRE(results.size() == 2);
+    REQUIRE(std::get<0>(results[0]) == false);
+    REQUIRE(std::get<0>(results[1]) == false);
+}
+
+TEST_CASE("Tablebase probes run alongside searches and reviews") {
+    fairystockfish::init();
+    auto position = fairystockfish::Position("chess", "8/8/8/8/8/4k3/8/4K2Q w - - 0 1");
+
+    // There are no table files here, the point is that probes keep running
+    // while the tables are reinitialized under them.
+    std::atomic<bool> stop{false};
+    std::atomic<int> probes{0};
+    std::thread prober([&] {
+        while (!stop) {
+            fairystockfish::probeWDL(position);
+            fairystockfish::probeDTZ(position);
+            ++probes;
+        }
+    });
+
+    fairystockfish::ReviewOptions options;
+    options.nodes = 2'000;
+    for (int i = 0; i < 3; ++i) {
+        fairystockfish::Engine::topMoves(fairystockfish::Position("chess"), 2, 5'000 + i);
+        fairystockfish::reviewGame("chess", "", {"e2e4", "e7e5"}, options);
+        fairystockfish::setUCIOption("Clear Hash", "");
+        // A new path each time, so that the tables really are reinitialized.
+        fairystockfish::initTablebases(i % 2 ? "<empty>" : "no-such-tablebases");
+    }
+    stop = true;
+    prober.join();
+    fairystockfish::initTablebases("<empty>");
+    REQUIRE(probes > 0);
+}
+
+TEST_CASE("initTablebases follows paths set through setUCIOption") {
+    fairystockfish::init();
+    fairystockfish::initTablebases("<empty>");
+    fairystockfish::setUCIOption("SyzygyPath", "no-such-tablebases");
+    fairystockfish::initTablebases("<empty>");
+    REQUIRE(std::string(Stockfish::Options["SyzygyPath"]) == "<empty>");
+}
+
+TEST_CASE("Engine::findMate") {
+    fairystockfish::init();
+    auto scholar = fairystockfish::Position(
+        "chess",
+        "r1bqkbnr/pppp1ppp/2n5/4p3/2B1P3/5Q2/PPPP1PPP/RNB1K1NR w KQkq - 0 1"
+    );
+    auto mate = fairystockfish::Engine::findMate(scholar, 3, 100'000);
+    REQUIRE(mate.found);
+    REQUIRE(mate.movesToMate == 1);
+    REQUIRE(mate.line.front() == "f3f7");
+
+    auto none = fairystockfish::Engine::findMate(fairystockfish::Position("chess"), 2, 10'000);
+    REQUIRE(!none.found);
+    REQUIRE(none.line.empty());
+
+    SUBCASE("In batches") {
+        std::vector<fairystockfish::MateResult> results;
+        auto stats = fairystockfish::Engine::findMates(
+            {scholar, fairystockfish::Position("chess")},
+            3,
+            10'000,
+            results
+        );
+        REQUIRE(stats.positions == 2);
+        REQUIRE(stats.mates == 1);
+        REQUIRE(results[0].found);
+        REQUIRE(!results[1].found);
+    }
+    REQUIRE_THROWS(fairystockfish::Engine::findMate(scholar, 0, 1'000));
+}
+
+TEST_CASE("Engine pondering") {
+    fairystockfish::init();
+    fairystockfish::Clock clock;
+    clock.wtime = clock.btime = 1'000;
+
+    // We played e2e4 and expect e7e5.
+    auto expected = fairystockfish::Position("chess").makeMoves({"e2e4", "e7e5"});
+    fairystockfish::Engine::ponder(expected, clock);
+    REQUIRE(fairystockfish::Engine::isPondering());
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    auto result = fairystockfish::Engine::ponderHit();
+    REQUIRE(!fairystockfish::Engine::isPondering());
+    auto legalMoves = expected.getLegalMoves();
+    REQUIRE(std::find(legalMoves.begin(), legalMoves.end(), result.bestMove) != legalMoves.end());
+    REQUIRE_THROWS(fairystockfish::Engine::ponderHit());
+
+    SUBCASE("A miss aborts the ponder search") {
+        fairystockfish::Engine::ponder(expected, clock);
+        fairystockfish::Engine::stopPondering();
+        REQUIRE(!fairystockfish::Engine::isPondering());
+    }
+
+    SUBCASE("Another search aborts the ponder search") {
+        fairystockfish::Engine::ponder(expected, clock);
+        auto actual = fairystockfish::Position("chess").makeMoves({"e2e4", "c7c5"});
+        REQUIRE(!fairystockfish::Engine::play(actual, clock).bestMove.empty());
+        REQUIRE(!fairystockfish::Engine::isPondering());
+    }
+}
+
+TEST_CASE("Search statistics") {
+    fairystockfish::init();
+    fairystockfish::Engine::resetSearchTotals();
+    fairystockfish::Engine::setSearchSampling(1);
+
+    fairystockfish::Clock clock;
+    clock.wtime = clock.btime = 2'000;
+    auto result = fairystockfish::Engine::play(fairystockfish::Position("chess"), clock);
+    fairystockfish::Engine::setSearchSampling(0);
+
+    auto stats = fairystockfish::Engine::lastSearchStats();
+    REQUIRE(!stats.running);
+    REQUIRE(stats.nodes > 0);
+    REQUIRE(stats.depth == result.depth);
+    REQUIRE(stats.threadNodes.size() == 1);
+    REQUIRE(stats.threadNodes[0] == stats.nodes);
+    REQUIRE(!stats.iterations.empty());
+    REQUIRE(stats.iterations.back().depth == stats.depth);
+    for (std::size_t i = 1; i < stats.iterations.size(); ++i) {
+        REQUIRE(stats.iterations[i].depth > stats.iterations[i - 1].depth);
+        REQUIRE(stats.iterations[i].nodes >= stats.iterations[i - 1].nodes);
+    }
+    REQUIRE(!fairystockfish::Engine::currentSearchStats().running);
+
+    auto totals = fairystockfish::Engine::searchTotals();
+    REQUIRE(totals.searches == 1);
+    REQUIRE(totals.nodes == stats.nodes);
+}
+
+TEST_CASE("Game review") {
+    fairystockfish::init();
+    // Scholar's mate, 3...Nf6?? allows 4.Qxf7#.
+    std::vector<std::string> moves = {"e2e4", "e7e5", "d1h5", "b8c6", "f1c4", "g8f6", "h5f7"};
+    fairystockfish::ReviewOptions options;
+    options.nodes = 20'000;
+
+    auto reviews = fairystockfish::reviewGame("chess", "", moves, options);
+    REQUIRE(reviews.size() == moves.size());
+    for (std::size_t i = 0; i < moves.size(); ++i) {
+        REQUIRE(reviews[i].ply == int(i));
+        REQUIRE(reviews[i].move == moves[i]);
+        REQUIRE(!reviews[i].bestMove.empty());
+    }
+    REQUIRE(reviews[5].judgement == fairystockfish::JUDGEMENT_BLUNDER);
+    REQUIRE(reviews[6].judgement == fairystockfish::JUDGEMENT_BEST);
+    REQUIRE(reviews[6].bestScore > fairystockfish::VALUE_MATE - 10);
+
+    SUBCASE("Reviews are streamed last move first") {
+        fairystockfish::GameReview gameReview("chess", "", moves, options);
+        fairystockfish::PlyReview review;
+        int expected = int(moves.size()) - 1;
+        while (gameReview.next(review)) REQUIRE(review.ply == expected--);
+        REQUIRE(expected == -1);
+    }
+
+    SUBCASE("A zero hash size gets the smallest table") {
+        options.hashMB = 0;
+        REQUIRE(fairystockfish::reviewGame("chess", "", {"e2e4"}, options).size() == 1);
+    }
+
+    SUBCASE("Chess960 games castle by taking the rook") {
+        std::string fen = "rk6/pppppppp/8/8/8/8/PPPPPPPP/RK5R w Q - 0 1";
+        REQUIRE(fairystockfish::reviewGame("chess", fen, {"b1a1"}, options, true).size() == 1);
+    }
+
+    REQUIRE_THROWS(fairystockfish::reviewGame("chess", "", {"e2e5"}, options));
+}
+
+#ifdef LARGEBOARDS
+TEST_CASE("Switching variants restores their evaluation tables") {
+    fairystockfish::init();
+    std::vector<std::string> chessFens
+        = {"rnbqkbnr/pppp1ppp/8/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R b KQkq - 1 2"};
+    std::vector<std::string> xiangqiFens
+        = {"rnbakabnr/9/1c5c1/p1p1p1p1p/9/9/P1P1P1P1P/1C5C1/9/RNBAKABNR w - - 0 1"};
+
+    std::vector<int> first, second, xiangqi;
+    fairystockfish::evaluateBatch("chess", chessFens, first);
+    fairystockfish::evaluateBatch("xiangqi", xiangqiFens, xiangqi);
+    fairystockfish::evaluateBatch("chess", chessFens, second);
+    REQUIRE(first == second);
+
+    fairystockfish::evaluateBatch("xiangqi", xiangqiFens, second);
+    REQUIRE(second == xiangqi);
+}
+#endif
+
+TEST_CASE("Engine::rateMoves") {
+    fairystockfish::init();
+    auto scholar = fairystockfish::Position(
+        "chess",
+        "r1bqkbnr/pppp1ppp/2n5/4p3/2B1P3/5Q2/PPPP1PPP/RNB1K1NR w KQkq - 0 1"
+    );
+    std::vector<std::string> candidates = {"a2a3", "f3f7", "b1c3"};
+    auto results = fairystockfish::Engine::rateMoves(scholar, candidates, 20'000);
+    REQUIRE(results.size() == candidates.size());
+    for (std::size_t i = 0; i < candidates.size(); ++i) {
+        REQUIRE(results[i].bestMove == candidates[i]);
+    }
+    REQUIRE(results[1].score > fairystockfish::VALUE_MATE - 10);
+    REQUIRE(results[0].score < results[1].score);
+
+    auto all = fairystockfish::Engine::rateMoves(scholar, {}, 20'000);
+    REQUIRE(all.size() == scholar.getLegalMoves().size());
+
+    REQUIRE_THROWS(fairystockfish::Engine::rateMoves(scholar, {"e1e3"}, 1'000));
+    REQUIRE_THROWS_AS(
+        fairystockfish::Engine::rateMoves(scholar, candidates, 0),
+        std::invalid_argument
+    );
+}
+
+TEST_CASE("Sliced searches can be interleaved") {
+    fairystockfish::init();
+    auto a = fairystockfish::Position("chess").makeMoves({"e2e4"});
+    auto b = fairystockfish::Position("chess").makeMoves({"d2d4", "d7d5"});
+    std::vector<std::unique_ptr<fairystockfish::SlicedSearch>> searches;
+    searches.push_back(std::make_unique<fairystockfish::SlicedSearch>(a, 5'000, 1'000));
+    searches.push_back(std::make_unique<fairystockfish::SlicedSearch>(b, 5'000, 1'000));
+
+    // Round robin until both are done.
+    int slices = 0;
+    while (!searches[0]->done() || !searches[1]->done()) {
+        for (auto &search : searches) search->step();
+        REQUIRE(++slices < 100);
+    }
+    REQUIRE(slices >= 2);
+
+    for (std::size_t i = 0; i < searches.size(); ++i) {
+        auto const &position = i == 0 ? a : b;
+        auto legalMoves      = position.getLegalMoves();
+        auto const &result   = searches[i]->result();
+        REQUIRE(searches[i]->nodes() == 5'000);
+        REQUIRE(
+            std::find(legalMoves.begin(), legalMoves.end(), result.bestMove) != legalMoves.end()
+        );
+    }
+}
+
+TEST_CASE("BotPool") {
+    fairystockfish::init();
+    fairystockfish::BotPool pool(4);
+    fairystockfish::BotConfig weak;
+    weak.skillLevel = 0;
+    weak.nodes      = 2'000;
+    weak.hashMB     = 0;  // Gets the smallest table
+    fairystockfish::BotConfig rated;
+    rated.elo    = 1'500;
+    rated.hashMB = 2;
+    int weakBot  = pool.createBot(weak);
+    int ratedBot = pool.createBot(rated);
+
+    auto position   = fairystockfish::Position("chess").makeMoves({"e2e4"});
+    auto legalMoves = position.getLegalMoves();
+    auto first      = pool.submit(weakBot, position);
+    auto second     = pool.submit(ratedBot, position);
+    for (auto *result : {&first, &second}) {
+        auto move = result->get().bestMove;
+        REQUIRE(std::find(legalMoves.begin(), legalMoves.end(), move) != legalMoves.end());
+    }
+    auto stats = pool.stats();
+    REQUIRE(stats.completed == 2);
+    REQUIRE(stats.p50Ms <= stats.p99Ms);
+
+    SUBCASE("The queue is bounded") {
+        std::vector<std::future<fairystockfish::SearchResult>> results;
+        std::uint64_t rejected = 0;
+        for (int i = 0; i < 20; ++i) {
+            try {
+                results.push_back(pool.submit(weakBot, position));
+            } catch (std::runtime_error const &) {
+                ++rejected;
+            }
+        }
+        for (auto &result : results) result.get();
+        REQUIRE(pool.stats().rejected == rejected);
+        REQUIRE(pool.stats().completed == 2 + results.size());
+    }
+
+    REQUIRE_THROWS(pool.submit(weakBot, fairystockfish::Position("crazyhouse")));
+    fairystockfish::BotConfig unlimited;
+    unlimited.nodes = 0;
+    REQUIRE_THROWS_AS(pool.createBot(unlimited), std::invalid_argument);
+    pool.removeBot(weakBot);
+    REQUIRE_THROWS(pool.submit(weakBot, position));
+}
+
+TEST_CASE("Engine state round trips through a file") {
+    fairystockfish::init();
+    fairystockfish::setUCIOption("Hash", "1");
+    fairystockfish::Clock clock;
+    clock.wtime = clock.btime = 500;
+    fairystockfish::Engine::play(fairystockfish::Position("chess"), clock);
+
+    std::string path = "engine_state_test.bin";
+    fairystockfish::Engine::saveState(path);
+    fairystockfish::setUCIOption("Hash", "2");
+    fairystockfish::Engine::loadState(path);
+    REQUIRE(fairystockfish::Engine::play(fairystockfish::Position("chess"), clock).depth > 0);
+
+    // Not an engine state.
+    std::ofstream(path, std::ios::binary | std::ios::trunc) << "garbage";
+    REQUIRE_THROWS(fairystockfish::Engine::loadState(path));
+    std::remove(path.c_str());
+    fairystockfish::setUCIOption("Hash", "16");
+}
+
+TEST_CASE("Engine state restores the whole hash table") {
+    fairystockfish::init();
+    fairystockfish::Clock clock;
+    clock.wtime = clock.btime = 500;
+    std::string path = "engine_state_table_test.bin";
+    for (char const *hashMB : {"1", "3", "64"}) {
+        fairystockfish::setUCIOption("Hash", hashMB);
+        fairystockfish::Engine::play(fairystockfish::Position("chess"), clock);
+
+        std::vector<char> saved;
+        {
+            std::lock_guard<std::mutex> guard(fairystockfish::internal::engineMutex());
+            auto *table = reinterpret_cast<char const *>(Stockfish::TT.first_entry(0));
+            saved.assign(table, table + fairystockfish::internal::hashTableBytes());
+        }
+        fairystockfish::Engine::saveState(path);
+        fairystockfish::setUCIOption("Clear Hash", "");
+        fairystockfish::Engine::loadState(path);
+
+        auto *table = reinterpret_cast<char const *>(Stockfish::TT.first_entry(0));
+        REQUIRE(std::equal(saved.begin(), saved.end(), table));
+    }
+    std::remove(path.c_str());
+    fairystockfish::setUCIOption("Hash", "16");
+}
+
+TEST_CASE("Init report") {
+    // Whichever mode initialized the library, the first search finishes it.
+    fairystockfish::init(true);
+    std::vector<int> scores;
+    fairystockfish::evaluateBatch("chess", {fairystockfish::initialFen("chess")}, scores);
+
+    fairystockfish::InitReport report = fairystockfish::initReport();
+    CHECK(report.searchReady);
+    std::vector<std::string> names;
+    double total = 0;
+    for (auto const &phase : report.phases) {
+        names.push_back(phase.name);
+        CHECK(phase.ms >= 0);
+        total += phase.ms;
+    }
+    CHECK(std::find(names.begin(), names.end(), "variants") != names.end());
+    CHECK(std::find(names.begin(), names.end(), "threads") != names.end());
+    CHECK(report.totalMs == doctest::Approx(total));
+    CHECK(fairystockfish::init().phases.size() == report.phases.size());
+}
+
+TEST_CASE("prepareFork stops the engine threads until the next search") {
+    fairystockfish::init();
+    std::vector<int> scores;
+    fairystockfish::evaluateBatch("chess", {fairystockfish::initialFen("chess")}, scores);
+    fairystockfish::prepareFork();
+    fairystockfish::setUCIOption("Hash", "8");
+
+    fairystockfish::evaluateBatch("chess", {fairystockfish::initialFen("chess")}, scores);
+    REQUIRE(scores.size() == 1);
+    auto results = fairystockfish::Engine::rateMoves(fairystockfish::Position("chess"), {}, 1'000);
+    REQUIRE(results.size() == 20);
+    fairystockfish::setUCIOption("Hash", "16");
+}
+
+TEST_CASE("Redefining a variant keeps existing positions") {
+    fairystockfish::init();
+    fairystockfish::loadVariantConfig(R"variants(
+[hotswap:breakthrough]
+maxFile = 5
+maxRank = 5
+startFen = ppppp/ppppp/5/PPPPP/PPPPP w 0 1
+    )variants");
+    fairystockfish::Position before("hotswap");
+    auto movesBefore = before.getLegalMoves();
+    auto topBefore   = fairystockfish::Engine::topMoves(before, 2, 5'000);
+    std::vector<int> scoresBefore;
+    fairystockfish::evaluateBatch(std::vector<fairystockfish::Position>{before}, scoresBefore);
+
+    fairystockfish::loadVariantConfig(R"variants(
+[hotswap:breakthrough]
+maxFile = 6
+maxRank = 6
+startFen = pppppp/pppppp/6/6/PPPPPP/PPPPPP w 0 1
+    )variants");
+    fairystockfish::Position after("hotswap");
+
+    CHECK(before.getFEN() == "ppppp/ppppp/5/PPPPP/PPPPP w 0 1");
+    CHECK(before.getLegalMoves() == movesBefore);
+    CHECK(before.makeMoves({movesBefore[0]}).getLegalMoves().size() > 0);
+    CHECK(after.getFEN() == "pppppp/pppppp/6/6/PPPPPP/PPPPPP w 0 1");
+    CHECK(fairystockfish::initialFen("hotswap") == after.getFEN());
+
+    SUBCASE("Searches and evaluations use the position's own definition") {
+        auto topAfter = fairystockfish::Engine::topMoves(before, 2, 5'000);
+        REQUIRE(topAfter.size() == topBefore.size());
+        for (std::size_t i = 0; i < topBefore.size(); ++i) {
+            CHECK(topAfter[i].bestMove == topBefore[i].bestMove);
+            CHECK(topAfter[i].score == topBefore[i].score);
+        }
+
+        std::vector<int> scores;
+        fairystockfish::evaluateBatch(std::vector<fairystockfish::Position>{before}, scores);
+        CHECK(scores == scoresBefore);
+        CHECK_THROWS(fairystockfish::evaluateBatch(
+            std::vector<fairystockfish::Position>{before, after},
+            scores
+        ));
+    }
+}
+
+TEST_CASE("perft") {
+    fairystockfish::init();
+    fairystockfish::Position position("chess");
+    CHECK(fairystockfish::perft(position, 0) == 1);
+    CHECK(fairystockfish::perft(position, 1) == 20);
+    CHECK(fairystockfish::perft(position, 3) == 8'902);
+    CHECK(fairystockfish::perft(position.makeMoves({"e2e4"}), 2) == 600);
+}
+
+#ifdef LARGEBOARDS
 TEST_CASE("fairystockfish invalid fens") {
     fairystockfish::init();
 
@@ -81,6 +790,7 @@ TEST_CASE("fairystockfish invalid fens") {
     // Obviously invalid
     REQUIRE(!fairystockfish::validateFEN("shogi", "I'm a Shogi FEN! (not)"));
 }
+#endif
 
 TEST_CASE("Chess checkmate FEN") {
     fairystockfish::init();
@@ -109,6 +819,7 @@ TEST_CASE("Chess Threefold") {
     // REQUIRE(result == Stockfish::VALUE_ZERO);
 }
 
+#ifdef LARGEBOARDS
 TEST_CASE("Shogi checkmate FEN") {
     fairystockfish::init();
     std::vector<std::string> mateFENs
@@ -177,6 +888,7 @@ TEST_CASE("Shogi Fools mate") {
     auto legalMoves = position.getLegalMoves();
     REQUIRE(legalMoves.size() == 0);
 }
+#endif
 
 TEST_CASE("Chess givesCheck returns true after check") {
     fairystockfish::init();
@@ -217,6 +929,7 @@ TEST_CASE("Chess stalemate is a draw") {
     REQUIRE(position.gameResult() == Stockfish::VALUE_DRAW);
 }
 
+#ifdef LARGEBOARDS
 TEST_CASE("Shogi stalemate is a win") {
     fairystockfish::init();
     std::string stalemateFEN = "8l/8k/9/8P/9/2P6/PP1PPPP2/1B5R1/LNSGKGSNL[] b - - 0 2";
@@ -225,6 +938,7 @@ TEST_CASE("Shogi stalemate is a win") {
     REQUIRE(position.getLegalMoves().size() == 0);
     REQUIRE(position.gameResult() == -Stockfish::VALUE_MATE);
 }
+#endif
 
 TEST_CASE("Chess king only is insufficientMaterial") {
     fairystockfish::init();
@@ -236,6 +950,7 @@ TEST_CASE("Chess king only is insufficientMaterial") {
     REQUIRE(std::get<1>(result));
 }
 
+#ifdef LARGEBOARDS
 TEST_CASE("Shogi king only is not insufficientMaterial") {
     fairystockfish::init();
     std::string insufficientMaterialFEN
@@ -245,6 +960,7 @@ TEST_CASE("Shogi king only is not insufficientMaterial") {
     REQUIRE(!std::get<0>(result));
     REQUIRE(!std::get<1>(result));
 }
+#endif
 
 TEST_CASE("Chess white king vs black king only should be insufficient material") {
     fairystockfish::init();
@@ -316,6 +1032,7 @@ TEST_CASE("Racing Kings Draw") {
     REQUIRE(position.gameResult() == Stockfish::VALUE_DRAW);
 }
 
+#ifdef LARGEBOARDS
 TEST_CASE("Available Variants") {
     fairystockfish::init();
     auto variants = fairystockfish::availableVariants();
@@ -639,6 +1356,7 @@ TEST_CASE("makeMoves and shogi repetition") {
         REQUIRE(std::get<0>(result));
     }
 }
+#endif
 
 TEST_CASE("passing in othello") {
     fairystockfish::init();
@@ -1060,6 +1778,7 @@ TEST_CASE("Perft") {
                   << "elapsed time: " << elapsed_seconds.count() << "s" << std::endl;
 }
 
+#ifdef LARGEBOARDS
 TEST_CASE("fairystockfish amazons") {
     fairystockfish::init();
     std::string initialFEN = fairystockfish::initialFen("amazons");
@@ -1092,6 +1811,7 @@ TEST_CASE("fairystockfish amazons") {
         REQUIRE(wallsOnBoard.find(i2) != wallsOnBoard.end());
     }
 }
+#endif
 
 /*
 // TODO: this test is failing, but we're just trying to figure it out anyways.
@@ -0,0 +1,136 @@
+// Benchmarks of the fairystockfish library.
+//
+// Usage: fairystockfish_bench <benchmark> [arguments...]
+//
+//   clock [games=10] [baseMs=10000] [incMs=100] [loadThreads=0] [variant=chess]
+//       Plays games of the engine against itself with Engine::play on a real
+//       clock, optionally while other threads keep the CPU busy, and reports
+//       the time forfeit rate.
+//
+//   perft [depth=5] [variant=chess]
+//       Counts the leaves of the legal move tree from the start position.
+//
+//   search [nodes=5000000] [variant=chess]
+//       Runs a single threaded search from the start position.
+//
+//   Comparing the numbers of a build with -DFAIRYSTOCKFISH_LARGEBOARDS=OFF to
+//   those of the default build shows what 128 bit bitboards cost.
+
+#include "fairystockfish.h"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+std::string argument(int argc, char **argv, int index, std::string fallback) {
+    return index < argc ? std::string(argv[index]) : fallback;
+}
+
+int clockBenchmark(int argc, char **argv) {
+    int games           = std::stoi(argument(argc, argv, 2, "10"));
+    int baseMs          = std::stoi(argument(argc, argv, 3, "10000"));
+    int incMs           = std::stoi(argument(argc, argv, 4, "100"));
+    int loadThreads     = std::stoi(argument(argc, argv, 5, "0"));
+    std::string variant = argument(argc, argv, 6, "chess");
+
+    // Simulated load from the rest of the host.
+    std::atomic<bool> stop{false};
+    std::vector<std::thread> load;
+    for (int i = 0; i < loadThreads; ++i) {
+        load.emplace_back([&stop] {
+            volatile std::uint64_t x = 0;
+            while (!stop) ++x;
+        });
+    }
+
+    fairystockfish::Engine::resetClockStats();
+    auto start = std::chrono::steady_clock::now();
+    for (int game = 0; game < games; ++game) {
+        fairystockfish::Position position(variant);
+        fairystockfish::Clock clock;
+        clock.wtime = clock.btime = baseMs;
+        clock.winc = clock.binc = incMs;
+
+        for (int ply = 0; ply < 400; ++ply) {
+            if (position.getLegalMoves().empty()) break;
+            if (std::get<0>(position.isOptionalGameEnd())) break;
+
+            bool white    = ply % 2 == 0;
+            int &timeLeft = white ? clock.wtime : clock.btime;
+            auto result   = fairystockfish::Engine::play(position, clock);
+            timeLeft     -= result.timeMs;
+            if (timeLeft <= 0 || result.bestMove.empty()) break;
+            timeLeft += incMs;
+            position = position.makeMoves({result.bestMove});
+        }
+        std::cout << "game " << game + 1 << " finished" << std::endl;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    stop = true;
+    for (auto &t : load) t.join();
+
+    auto stats = fairystockfish::Engine::clockStats();
+    std::cout << "moves:          " << stats.moves << "\n"
+              << "time forfeits:  " << stats.timeForfeits << "\n"
+              << "forfeit rate:   "
+              << (stats.moves ? double(stats.timeForfeits) / double(stats.moves) : 0.0) << "\n"
+              << "avg ms / move:  "
+              << (stats.moves ? double(stats.totalTimeMs) / double(stats.moves) : 0.0) << "\n"
+              << "wall time (s):  " << elapsed.count() << std::endl;
+    return 0;
+}
+
+int perftBenchmark(int argc, char **argv) {
+    int depth           = std::stoi(argument(argc, argv, 2, "5"));
+    std::string variant = argument(argc, argv, 3, "chess");
+
+    fairystockfish::Position position(variant);
+    auto start          = std::chrono::steady_clock::now();
+    std::uint64_t nodes = fairystockfish::perft(position, depth);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << "nodes:          " << nodes << "\n"
+              << "time (s):       " << elapsed.count() << "\n"
+              << "nodes / second: " << double(nodes) / elapsed.count() << std::endl;
+    return 0;
+}
+
+int searchBenchmark(int argc, char **argv) {
+    std::uint64_t nodes = std::stoull(argument(argc, argv, 2, "5000000"));
+    std::string variant = argument(argc, argv, 3, "chess");
+
+    // topMoves searches on one thread with a fresh table, so runs compare.
+    fairystockfish::Position position(variant);
+    auto start  = std::chrono::steady_clock::now();
+    auto result = fairystockfish::Engine::topMoves(position, 1, nodes);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::uint64_t searched = result.empty() ? 0 : result[0].nodes;
+    std::cout << "nodes:          " << searched << "\n"
+              << "depth:          " << (result.empty() ? 0 : result[0].depth) << "\n"
+              << "time (s):       " << elapsed.count() << "\n"
+              << "nodes / second: " << double(searched) / elapsed.count() << std::endl;
+    return 0;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    fairystockfish::init();
+
+    std::string benchmark = argument(argc, argv, 1, "");
+    if (benchmark == "clock") return clockBenchmark(argc, argv);
+    if (benchmark == "perft") return perftBenchmark(argc, argv);
+    if (benchmark == "search") return searchBenchmark(argc, argv);
+
+    std::cerr << "Usage: " << argv[0] << " clock [games] [baseMs] [incMs] [loadThreads] [variant]\n"
+              << "       " << argv[0] << " perft [depth] [variant]\n"
+              << "       " << argv[0] << " search [nodes] [variant]" << std::endl;
+    return 1;
+}
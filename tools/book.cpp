@@ -0,0 +1,47 @@
+// Builds an opening book for Engine::loadBook from a game archive.
+//
+// Usage: fairystockfish_book <variant> <games> <output> [maxPly=20] [minWeight=1]
+//
+// The games file has one game per line, as UCI moves separated by spaces from
+// the variant's start position. Anything after a ';' on a line is ignored, so
+// results or comments can be kept next to the moves.
+
+#include "fairystockfish.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+    if (argc < 4) {
+        std::cerr << "Usage: " << argv[0] << " <variant> <games> <output> [maxPly] [minWeight]"
+                  << std::endl;
+        return 1;
+    }
+    std::string variant = argv[1];
+    int maxPly          = argc > 4 ? std::stoi(argv[4]) : 20;
+    int minWeight       = argc > 5 ? std::stoi(argv[5]) : 1;
+
+    std::ifstream in(argv[2]);
+    if (!in) {
+        std::cerr << "Cannot read " << argv[2] << std::endl;
+        return 1;
+    }
+
+    fairystockfish::init();
+    std::vector<std::vector<std::string>> games;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream moves(line.substr(0, line.find(';')));
+        std::vector<std::string> game;
+        for (std::string move; moves >> move && int(game.size()) < maxPly;) game.push_back(move);
+        if (!game.empty()) games.push_back(std::move(game));
+    }
+
+    std::size_t entries
+        = fairystockfish::buildBook(variant, games, argv[3], maxPly, std::uint32_t(minWeight));
+    std::cout << games.size() << " games, " << entries << " book entries" << std::endl;
+    return 0;
+}